@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * USB endpoint bandwidth calculations
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include "bandwidth.h"
+#include "usbmisc.h"
+
+#define USB_DT_SSP_ISOC_EP_COMP		0x31
+
+/*
+ * Bytes of protocol overhead per transaction (USB 2.0 section 5.8.4 and
+ * 5.9.3) and per SuperSpeed data packet (header packet, framing and
+ * CRCs).  The SuperSpeed round trip is an estimate of the time a burst
+ * waits for its acknowledgement, hubs not included.
+ */
+#define BW_FS_BULK_OVERHEAD		13
+#define BW_HS_BULK_OVERHEAD		55
+#define BW_LS_CONTROL_OVERHEAD		63
+#define BW_FS_CONTROL_OVERHEAD		45
+#define BW_HS_CONTROL_OVERHEAD		173
+#define BW_SS_PACKET_OVERHEAD		28
+#define BW_SS_ROUND_TRIP_NS		1000
+
+/* ---------------------------------------------------------------------- */
+
+/* the SuperSpeed endpoint companion of an endpoint, or NULL */
+const unsigned char *bw_ss_ep_comp(const struct libusb_endpoint_descriptor *ep)
+{
+	const unsigned char *buf = ep->extra;
+	int size = ep->extra_length;
+
+	while (buf && size >= 2) {
+		if (buf[0] < 2 || buf[0] > size)
+			break;
+		if (buf[1] == USB_DT_SS_ENDPOINT_COMP && buf[0] >= 6)
+			return buf;
+		size -= buf[0];
+		buf += buf[0];
+	}
+	return NULL;
+}
+
+/* the SuperSpeedPlus isochronous companion following the SS companion */
+static const unsigned char *find_ssp_isoc_comp(const struct libusb_endpoint_descriptor *ep)
+{
+	const unsigned char *buf = ep->extra;
+	int size = ep->extra_length;
+
+	while (buf && size >= 2) {
+		if (buf[0] < 2 || buf[0] > size)
+			break;
+		if (buf[1] == USB_DT_SSP_ISOC_EP_COMP && buf[0] >= 8)
+			return buf;
+		size -= buf[0];
+		buf += buf[0];
+	}
+	return NULL;
+}
+
+const char *bw_speed_name(int speed)
+{
+	switch (speed) {
+	case LIBUSB_SPEED_LOW:
+		return "low-speed";
+	case LIBUSB_SPEED_FULL:
+		return "full-speed";
+	case LIBUSB_SPEED_HIGH:
+		return "high-speed";
+	case LIBUSB_SPEED_SUPER:
+		return "SuperSpeed";
+	case LIBUSB_SPEED_SUPER_PLUS:
+		return "SuperSpeed+";
+	default:
+		return "unknown speed";
+	}
+}
+
+unsigned int bw_intervals_per_second(int speed)
+{
+	return speed >= LIBUSB_SPEED_HIGH ? 8000 : 1000;
+}
+
+/*
+ * Service interval of a periodic endpoint in bus intervals.  Control and
+ * bulk endpoints can be serviced in every bus interval.
+ */
+unsigned int bw_ep_interval(const struct libusb_endpoint_descriptor *ep, int speed)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	unsigned int binterval = ep->bInterval;
+
+	if (type == LIBUSB_TRANSFER_TYPE_CONTROL ||
+	    type == LIBUSB_TRANSFER_TYPE_BULK)
+		return 1;
+
+	/* full/low speed interrupt endpoints count plain frames */
+	if (speed < LIBUSB_SPEED_HIGH && type == LIBUSB_TRANSFER_TYPE_INTERRUPT)
+		return binterval ? binterval : 1;
+
+	if (binterval < 1)
+		binterval = 1;
+	else if (binterval > 16)
+		binterval = 16;
+	return 1U << (binterval - 1);
+}
+
+/*
+ * Bytes a periodic endpoint may move in one service interval, including
+ * high-bandwidth transactions and SuperSpeed bursts.
+ */
+unsigned int bw_ep_bytes_per_interval(const struct libusb_endpoint_descriptor *ep, int speed)
+{
+	unsigned int wmax = ep->wMaxPacketSize;
+	unsigned int maxp = wmax & 0x7ff;
+	const unsigned char *comp;
+
+	if (speed >= LIBUSB_SPEED_SUPER) {
+		comp = bw_ss_ep_comp(ep);
+		/* SuperSpeedPlus isochronous endpoints may need 32 bits */
+		if (comp && (comp[3] & 0x80) &&
+		    (ep->bmAttributes & 3) == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS) {
+			const unsigned char *ssp = find_ssp_isoc_comp(ep);
+
+			if (ssp)
+				return ssp[4] | (ssp[5] << 8) | (ssp[6] << 16) |
+					((unsigned int)ssp[7] << 24);
+		}
+		if (comp && (comp[4] | (comp[5] << 8)))
+			return comp[4] | (comp[5] << 8);
+		if (comp)
+			return maxp * (comp[2] + 1) *
+				((ep->bmAttributes & 3) == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS ?
+				 (comp[3] & 0x3) + 1 : 1);
+		return maxp;
+	}
+	if (speed == LIBUSB_SPEED_HIGH)
+		return maxp * (((wmax >> 11) & 3) + 1);
+	return wmax & 0x3ff;
+}
+
+/*
+ * Periodic bandwidth reserved by an isochronous or interrupt endpoint;
+ * zero for control and bulk endpoints, which reserve nothing.
+ */
+unsigned long long bw_ep_bytes_per_second(const struct libusb_endpoint_descriptor *ep, int speed)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+
+	if (type == LIBUSB_TRANSFER_TYPE_CONTROL ||
+	    type == LIBUSB_TRANSFER_TYPE_BULK)
+		return 0;
+
+	return (unsigned long long)bw_ep_bytes_per_interval(ep, speed) *
+		bw_intervals_per_second(speed) / bw_ep_interval(ep, speed);
+}
+
+/* data bytes per second the link itself can carry */
+unsigned long long bw_link_bytes_per_second(int speed)
+{
+	switch (speed) {
+	case LIBUSB_SPEED_LOW:
+		return 1500000 / 8;
+	case LIBUSB_SPEED_FULL:
+		return 12000000 / 8;
+	case LIBUSB_SPEED_HIGH:
+		return 480000000 / 8;
+	case LIBUSB_SPEED_SUPER:
+		return 5000000000ULL / 10;		/* 8b/10b */
+	case LIBUSB_SPEED_SUPER_PLUS:
+		return 10000000000ULL / 132 * 128 / 8;	/* 128b/132b */
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Best case throughput of a bulk or control endpoint alone on the bus.
+ * Below SuperSpeed it is the number of whole transactions that fit in a
+ * bus interval; at SuperSpeed a burst of bMaxBurst + 1 packets has to
+ * wait for its acknowledgement before the next one can start.
+ */
+static unsigned long long async_throughput(const struct libusb_endpoint_descriptor *ep,
+					   int speed)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	unsigned long long link = bw_link_bytes_per_second(speed);
+	unsigned int maxp = ep->wMaxPacketSize & 0x7ff;
+	unsigned int overhead, per_interval, burst = 1;
+	const unsigned char *comp;
+	unsigned long long burst_bytes, burst_ns;
+
+	if (!maxp || !link)
+		return 0;
+
+	if (speed >= LIBUSB_SPEED_SUPER) {
+		comp = bw_ss_ep_comp(ep);
+		if (comp)
+			burst = comp[2] + 1;
+		burst_bytes = (unsigned long long)burst * maxp;
+		burst_ns = (unsigned long long)burst * (maxp + BW_SS_PACKET_OVERHEAD) *
+			1000000000ULL / link + BW_SS_ROUND_TRIP_NS;
+		return burst_bytes * 1000000000ULL / burst_ns;
+	}
+
+	if (type == LIBUSB_TRANSFER_TYPE_CONTROL)
+		overhead = speed == LIBUSB_SPEED_HIGH ? BW_HS_CONTROL_OVERHEAD :
+			   speed == LIBUSB_SPEED_FULL ? BW_FS_CONTROL_OVERHEAD :
+			   BW_LS_CONTROL_OVERHEAD;
+	else
+		overhead = speed == LIBUSB_SPEED_HIGH ? BW_HS_BULK_OVERHEAD :
+			   BW_FS_BULK_OVERHEAD;
+	per_interval = link / bw_intervals_per_second(speed) / (maxp + overhead);
+	return (unsigned long long)per_interval * maxp * bw_intervals_per_second(speed);
+}
+
+/*
+ * Theoretical maximum throughput of any endpoint: the reserved bandwidth
+ * of periodic endpoints, or what a bulk or control endpoint can move with
+ * the bus to itself.
+ */
+unsigned long long bw_ep_max_throughput(const struct libusb_endpoint_descriptor *ep,
+					int speed)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+
+	if (type == LIBUSB_TRANSFER_TYPE_CONTROL ||
+	    type == LIBUSB_TRANSFER_TYPE_BULK)
+		return async_throughput(ep, speed);
+	return bw_ep_bytes_per_second(ep, speed);
+}
+
+/* "12.3 MB/s" style, decimal units */
+char *bw_format_rate(char *buf, size_t size, unsigned long long bps)
+{
+	if (bps >= 1000000)
+		snprintf(buf, size, "%llu.%llu MB/s", bps / 1000000,
+			 bps / 100000 % 10);
+	else if (bps >= 1000)
+		snprintf(buf, size, "%llu.%llu kB/s", bps / 1000, bps / 100 % 10);
+	else
+		snprintf(buf, size, "%llu B/s", bps);
+	return buf;
+}
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * USB endpoint bandwidth calculations
+ */
+
+#ifndef _BANDWIDTH_H
+#define _BANDWIDTH_H
+
+#include <stddef.h>
+#include <libusb.h>
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ * All "bus intervals" below are frames (1 ms) for low and full speed
+ * devices and microframes (125 us) for high speed and faster devices.
+ * Speeds are the LIBUSB_SPEED_* values from libusb_get_device_speed().
+ */
+
+extern const char *bw_speed_name(int speed);
+extern unsigned int bw_intervals_per_second(int speed);
+
+extern const unsigned char *bw_ss_ep_comp(const struct libusb_endpoint_descriptor *ep);
+extern unsigned int bw_ep_interval(const struct libusb_endpoint_descriptor *ep,
+				   int speed);
+extern unsigned int bw_ep_bytes_per_interval(const struct libusb_endpoint_descriptor *ep,
+					     int speed);
+extern unsigned long long bw_ep_bytes_per_second(const struct libusb_endpoint_descriptor *ep,
+						 int speed);
+
+/* bytes per second */
+extern unsigned long long bw_link_bytes_per_second(int speed);
+extern unsigned long long bw_ep_max_throughput(const struct libusb_endpoint_descriptor *ep,
+					       int speed);
+extern char *bw_format_rate(char *buf, size_t size, unsigned long long bps);
+
+/* ---------------------------------------------------------------------- */
+#endif /* _BANDWIDTH_H */
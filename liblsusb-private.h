@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * liblsusb internals, shared with lsusb, which links the library in
+ * statically.  Not installed: the layouts here may change at any time.
+ */
+
+#ifndef _LIBLSUSB_PRIVATE_H
+#define _LIBLSUSB_PRIVATE_H
+
+#include <sys/types.h>
+
+#include <libusb.h>
+
+#include "liblsusb.h"
+
+/* ---------------------------------------------------------------------- */
+
+struct liblsusb_device {
+	libusb_device *usb;
+	struct liblsusb_device *parent;		/* NULL for root hubs */
+	uint8_t busnum;
+	uint8_t devnum;
+	uint8_t depth;				/* 0 for root hubs */
+	char path[32];				/* sysfs name: "usb1", "1-2.3" */
+	unsigned int speed;			/* kbit/s, 0 if unknown */
+	struct libusb_device_descriptor desc;
+	char vendor[128];
+	char product[128];
+	char serial[128];
+};
+
+struct liblsusb_endpoint {
+	uint8_t address;
+	uint8_t attributes;
+	uint16_t max_packet_size;
+	uint8_t interval;
+};
+
+struct liblsusb_interface {
+	uint8_t number;
+	uint8_t alt_setting;
+	uint8_t interface_class;
+	uint8_t interface_subclass;
+	uint8_t interface_protocol;
+	char driver[64];
+	size_t num_endpoints;
+	struct liblsusb_endpoint *endpoints;
+};
+
+struct liblsusb_config {
+	uint8_t value;
+	uint8_t attributes;
+	unsigned int max_power;			/* mA */
+	uint8_t num_interfaces;
+	size_t num_altsettings;
+	struct liblsusb_interface *altsettings;
+};
+
+struct usb_match;
+
+/*
+ * The devices of a libusb context selected by match (all of them if NULL),
+ * in libusb's order, as a NULL terminated list for liblsusb_free_devices().
+ * Returns the number of devices, or a negative libusb error code.  Names
+ * are looked up with names_init() already done by the caller.
+ */
+extern ssize_t get_device_records(libusb_context *ctx,
+				  const struct usb_match *match,
+				  struct liblsusb_device ***devices);
+
+/* ---------------------------------------------------------------------- */
+#endif /* _LIBLSUSB_PRIVATE_H */
@@ -0,0 +1,494 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * liblsusb - USB device inventory without running lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "liblsusb-private.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#define MAX_DEPTH	7		/* tiers of hubs below the root hub */
+
+/* Gen 2x2 came with libusb 1.0.27 */
+#if !defined(LIBUSB_API_VERSION) || LIBUSB_API_VERSION < 0x0100010A
+#define LIBUSB_SPEED_SUPER_PLUS_X2	6
+#endif
+
+struct liblsusb {
+	libusb_context *usb;
+	int names;			/* names_init() succeeded */
+};
+
+/* ---------------------------------------------------------------------- */
+
+int liblsusb_new(struct liblsusb **ctx)
+{
+	struct liblsusb *c;
+	int err;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return LIBUSB_ERROR_NO_MEM;
+	err = libusb_init(&c->usb);
+	if (err) {
+		free(c);
+		return err;
+	}
+	c->names = names_init() >= 0;
+	*ctx = c;
+	return 0;
+}
+
+void liblsusb_free(struct liblsusb *ctx)
+{
+	if (!ctx)
+		return;
+	if (ctx->names)
+		names_exit();
+	libusb_exit(ctx->usb);
+	free(ctx);
+}
+
+/* ---------------------------------------------------------------------- */
+
+static unsigned int speed_kbps(int speed)
+{
+	switch (speed) {
+	case LIBUSB_SPEED_LOW:
+		return 1500;
+	case LIBUSB_SPEED_FULL:
+		return 12000;
+	case LIBUSB_SPEED_HIGH:
+		return 480000;
+	case LIBUSB_SPEED_SUPER:
+		return 5000000;
+	case LIBUSB_SPEED_SUPER_PLUS:
+		return 10000000;
+	case LIBUSB_SPEED_SUPER_PLUS_X2:
+		return 20000000;
+	default:
+		return 0;
+	}
+}
+
+/* the sysfs name, from the port numbers rather than a scan of sysfs */
+static int fill_path(struct liblsusb_device *d, libusb_device *dev)
+{
+	uint8_t ports[MAX_DEPTH];
+	int n, i, len;
+
+	n = libusb_get_port_numbers(dev, ports, sizeof(ports));
+	if (n < 0)
+		return n;
+	d->depth = n;
+	if (!n) {
+		snprintf(d->path, sizeof(d->path), "usb%u", d->busnum);
+		return 0;
+	}
+	len = snprintf(d->path, sizeof(d->path), "%u-%u", d->busnum, ports[0]);
+	for (i = 1; i < n && len < (int)sizeof(d->path); i++)
+		len += snprintf(d->path + len, sizeof(d->path) - len, ".%u", ports[i]);
+	return 0;
+}
+
+/*
+ * Fills in a record, or returns non-zero to leave the device out: on error,
+ * or when it is not one of those selected by match.  The selection is made
+ * before the names are looked up, so skipped devices cost next to nothing.
+ */
+static int fill_device(struct liblsusb_device *d, libusb_device *dev,
+		       const struct usb_match *match)
+{
+	struct usb_match ids;
+	int err;
+
+	err = libusb_get_device_descriptor(dev, &d->desc);
+	if (err)
+		return err;
+	if (match) {
+		/* the serial number is compared once it has been read below */
+		ids = *match;
+		ids.serial = NULL;
+		if (!usb_match_device(dev, &d->desc, &ids))
+			return 1;
+	}
+	d->busnum = libusb_get_bus_number(dev);
+	d->devnum = libusb_get_device_address(dev);
+	d->speed = speed_kbps(libusb_get_device_speed(dev));
+	err = fill_path(d, dev);
+	if (err)
+		return err;
+
+	if (read_sysfs_attr(d->serial, sizeof(d->serial), d->path, "serial"))
+		d->serial[0] = 0;
+	if (match && match->serial && strcmp(d->serial, match->serial))
+		return 1;
+
+	/* the database first, like lsusb always did; the device's strings else */
+	if (!get_vendor_string(d->vendor, sizeof(d->vendor), d->desc.idVendor) &&
+	    read_sysfs_attr(d->vendor, sizeof(d->vendor), d->path, "manufacturer"))
+		d->vendor[0] = 0;
+	if (!get_product_string(d->product, sizeof(d->product), d->desc.idVendor,
+				d->desc.idProduct) &&
+	    read_sysfs_attr(d->product, sizeof(d->product), d->path, "product"))
+		d->product[0] = 0;
+
+	d->usb = libusb_ref_device(dev);
+	return 0;
+}
+
+/* hubs sort before what is behind them, as their path is a prefix */
+static int cmp_devices(const void *a, const void *b)
+{
+	const struct liblsusb_device *da = *(struct liblsusb_device * const *)a;
+	const struct liblsusb_device *db = *(struct liblsusb_device * const *)b;
+	uint8_t pa[MAX_DEPTH], pb[MAX_DEPTH];
+	int na, nb, i;
+
+	if (da->busnum != db->busnum)
+		return da->busnum - db->busnum;
+	na = libusb_get_port_numbers(da->usb, pa, sizeof(pa));
+	nb = libusb_get_port_numbers(db->usb, pb, sizeof(pb));
+	for (i = 0; i < na && i < nb; i++)
+		if (pa[i] != pb[i])
+			return pa[i] - pb[i];
+	return na - nb;
+}
+
+ssize_t get_device_records(libusb_context *ctx, const struct usb_match *match,
+			   struct liblsusb_device ***devices)
+{
+	struct liblsusb_device **list, *d;
+	libusb_device **usb;
+	ssize_t n, i, j, k;
+
+	n = libusb_get_device_list(ctx, &usb);
+	if (n < 0)
+		return n;
+
+	/* one allocation: the NULL terminated pointers, then the records */
+	list = calloc(1, (n + 1) * sizeof(*list) + n * sizeof(*d));
+	if (!list) {
+		libusb_free_device_list(usb, 1);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+	d = (struct liblsusb_device *)(list + n + 1);
+	for (i = 0, j = 0; i < n; i++)
+		if (!fill_device(&d[j], usb[i], match)) {
+			list[j] = &d[j];
+			j++;
+		}
+	libusb_free_device_list(usb, 1);
+
+	for (i = 0; i < j; i++) {
+		libusb_device *parent = libusb_get_parent(list[i]->usb);
+
+		for (k = 0; parent && k < j; k++)
+			if (list[k]->usb == parent) {
+				list[i]->parent = list[k];
+				break;
+			}
+	}
+
+	*devices = list;
+	return j;
+}
+
+ssize_t liblsusb_get_devices(struct liblsusb *ctx, struct liblsusb_device ***devices)
+{
+	ssize_t n;
+
+	n = get_device_records(ctx->usb, NULL, devices);
+	if (n > 0)
+		qsort(*devices, n, sizeof(**devices), cmp_devices);
+	return n;
+}
+
+void liblsusb_free_devices(struct liblsusb_device **devices)
+{
+	size_t i;
+
+	if (!devices)
+		return;
+	for (i = 0; devices[i]; i++)
+		libusb_unref_device(devices[i]->usb);
+	free(devices);
+}
+
+struct liblsusb_device *liblsusb_device_parent(const struct liblsusb_device *dev)
+{
+	return dev->parent;
+}
+
+uint8_t liblsusb_device_busnum(const struct liblsusb_device *dev)
+{
+	return dev->busnum;
+}
+
+uint8_t liblsusb_device_devnum(const struct liblsusb_device *dev)
+{
+	return dev->devnum;
+}
+
+uint8_t liblsusb_device_depth(const struct liblsusb_device *dev)
+{
+	return dev->depth;
+}
+
+const char *liblsusb_device_path(const struct liblsusb_device *dev)
+{
+	return dev->path;
+}
+
+unsigned int liblsusb_device_speed(const struct liblsusb_device *dev)
+{
+	return dev->speed;
+}
+
+uint16_t liblsusb_device_bcd_usb(const struct liblsusb_device *dev)
+{
+	return dev->desc.bcdUSB;
+}
+
+uint8_t liblsusb_device_class(const struct liblsusb_device *dev)
+{
+	return dev->desc.bDeviceClass;
+}
+
+uint8_t liblsusb_device_subclass(const struct liblsusb_device *dev)
+{
+	return dev->desc.bDeviceSubClass;
+}
+
+uint8_t liblsusb_device_protocol(const struct liblsusb_device *dev)
+{
+	return dev->desc.bDeviceProtocol;
+}
+
+uint8_t liblsusb_device_max_packet_size0(const struct liblsusb_device *dev)
+{
+	return dev->desc.bMaxPacketSize0;
+}
+
+uint16_t liblsusb_device_vendor_id(const struct liblsusb_device *dev)
+{
+	return dev->desc.idVendor;
+}
+
+uint16_t liblsusb_device_product_id(const struct liblsusb_device *dev)
+{
+	return dev->desc.idProduct;
+}
+
+uint16_t liblsusb_device_bcd_device(const struct liblsusb_device *dev)
+{
+	return dev->desc.bcdDevice;
+}
+
+uint8_t liblsusb_device_num_configurations(const struct liblsusb_device *dev)
+{
+	return dev->desc.bNumConfigurations;
+}
+
+const char *liblsusb_device_vendor(const struct liblsusb_device *dev)
+{
+	return dev->vendor;
+}
+
+const char *liblsusb_device_product(const struct liblsusb_device *dev)
+{
+	return dev->product;
+}
+
+const char *liblsusb_device_serial(const struct liblsusb_device *dev)
+{
+	return dev->serial;
+}
+
+/* ---------------------------------------------------------------------- */
+
+int liblsusb_get_active_config(struct liblsusb *ctx,
+			       const struct liblsusb_device *dev,
+			       struct liblsusb_config **config)
+{
+	struct libusb_config_descriptor *desc;
+	struct liblsusb_config *c;
+	struct liblsusb_interface *alt;
+	size_t nalts = 0, neps = 0;
+	struct liblsusb_endpoint *ep;
+	int i, j, k, err;
+
+	(void)ctx;
+	err = libusb_get_active_config_descriptor(dev->usb, &desc);
+	if (err)
+		return err;
+	for (i = 0; i < desc->bNumInterfaces; i++)
+		for (j = 0; j < desc->interface[i].num_altsetting; j++) {
+			nalts++;
+			neps += desc->interface[i].altsetting[j].bNumEndpoints;
+		}
+
+	/* one allocation: the config, then the interfaces, then the endpoints */
+	c = calloc(1, sizeof(*c) + nalts * sizeof(*alt) + neps * sizeof(*ep));
+	if (!c) {
+		libusb_free_config_descriptor(desc);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+	c->value = desc->bConfigurationValue;
+	c->attributes = desc->bmAttributes;
+	c->max_power = desc->MaxPower * (dev->speed >= 5000000 ? 8 : 2);
+	c->num_interfaces = desc->bNumInterfaces;
+	c->num_altsettings = nalts;
+	c->altsettings = alt = (struct liblsusb_interface *)(c + 1);
+	ep = (struct liblsusb_endpoint *)(alt + nalts);
+
+	for (i = 0; i < desc->bNumInterfaces; i++)
+		for (j = 0; j < desc->interface[i].num_altsetting; j++, alt++) {
+			const struct libusb_interface_descriptor *d =
+				&desc->interface[i].altsetting[j];
+
+			alt->number = d->bInterfaceNumber;
+			alt->alt_setting = d->bAlternateSetting;
+			alt->interface_class = d->bInterfaceClass;
+			alt->interface_subclass = d->bInterfaceSubClass;
+			alt->interface_protocol = d->bInterfaceProtocol;
+			if (get_interface_driver_sysfs(alt->driver, sizeof(alt->driver),
+						       dev->path, c->value, d->bInterfaceNumber))
+				alt->driver[0] = 0;
+			alt->num_endpoints = d->bNumEndpoints;
+			alt->endpoints = ep;
+			for (k = 0; k < d->bNumEndpoints; k++, ep++) {
+				ep->address = d->endpoint[k].bEndpointAddress;
+				ep->attributes = d->endpoint[k].bmAttributes;
+				ep->max_packet_size = d->endpoint[k].wMaxPacketSize;
+				ep->interval = d->endpoint[k].bInterval;
+			}
+		}
+
+	libusb_free_config_descriptor(desc);
+	*config = c;
+	return 0;
+}
+
+void liblsusb_free_config(struct liblsusb_config *config)
+{
+	free(config);
+}
+
+uint8_t liblsusb_config_value(const struct liblsusb_config *config)
+{
+	return config->value;
+}
+
+uint8_t liblsusb_config_attributes(const struct liblsusb_config *config)
+{
+	return config->attributes;
+}
+
+unsigned int liblsusb_config_max_power(const struct liblsusb_config *config)
+{
+	return config->max_power;
+}
+
+uint8_t liblsusb_config_num_interfaces(const struct liblsusb_config *config)
+{
+	return config->num_interfaces;
+}
+
+size_t liblsusb_config_num_altsettings(const struct liblsusb_config *config)
+{
+	return config->num_altsettings;
+}
+
+const struct liblsusb_interface *
+liblsusb_config_altsetting(const struct liblsusb_config *config, size_t i)
+{
+	return i < config->num_altsettings ? &config->altsettings[i] : NULL;
+}
+
+uint8_t liblsusb_interface_number(const struct liblsusb_interface *intf)
+{
+	return intf->number;
+}
+
+uint8_t liblsusb_interface_alt_setting(const struct liblsusb_interface *intf)
+{
+	return intf->alt_setting;
+}
+
+uint8_t liblsusb_interface_class(const struct liblsusb_interface *intf)
+{
+	return intf->interface_class;
+}
+
+uint8_t liblsusb_interface_subclass(const struct liblsusb_interface *intf)
+{
+	return intf->interface_subclass;
+}
+
+uint8_t liblsusb_interface_protocol(const struct liblsusb_interface *intf)
+{
+	return intf->interface_protocol;
+}
+
+const char *liblsusb_interface_driver(const struct liblsusb_interface *intf)
+{
+	return intf->driver;
+}
+
+size_t liblsusb_interface_num_endpoints(const struct liblsusb_interface *intf)
+{
+	return intf->num_endpoints;
+}
+
+const struct liblsusb_endpoint *
+liblsusb_interface_endpoint(const struct liblsusb_interface *intf, size_t i)
+{
+	return i < intf->num_endpoints ? &intf->endpoints[i] : NULL;
+}
+
+uint8_t liblsusb_endpoint_address(const struct liblsusb_endpoint *ep)
+{
+	return ep->address;
+}
+
+uint8_t liblsusb_endpoint_attributes(const struct liblsusb_endpoint *ep)
+{
+	return ep->attributes;
+}
+
+uint16_t liblsusb_endpoint_max_packet_size(const struct liblsusb_endpoint *ep)
+{
+	return ep->max_packet_size;
+}
+
+uint8_t liblsusb_endpoint_interval(const struct liblsusb_endpoint *ep)
+{
+	return ep->interval;
+}
+
+/* ---------------------------------------------------------------------- */
+
+const char *liblsusb_vendor_name(struct liblsusb *ctx, uint16_t vendor_id)
+{
+	return ctx->names ? names_vendor(vendor_id) : NULL;
+}
+
+const char *liblsusb_product_name(struct liblsusb *ctx, uint16_t vendor_id,
+				  uint16_t product_id)
+{
+	return ctx->names ? names_product(vendor_id, product_id) : NULL;
+}
+
+const char *liblsusb_class_name(struct liblsusb *ctx, uint8_t class_id)
+{
+	return ctx->names ? names_class(class_id) : NULL;
+}
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * liblsusb - USB device inventory without running lsusb
+ *
+ * The devices, their place in the topology, their names from the hwdb or
+ * usb.ids, and their active configuration.  Nothing is printed and no
+ * device is opened, so no special permissions are needed beyond reading
+ * sysfs.
+ *
+ *	struct liblsusb *ctx;
+ *	struct liblsusb_device **devs;
+ *	size_t i;
+ *
+ *	if (liblsusb_new(&ctx) < 0)
+ *		return -1;
+ *	if (liblsusb_get_devices(ctx, &devs) >= 0) {
+ *		for (i = 0; devs[i]; i++)
+ *			printf("%s %04x:%04x %s\n", liblsusb_device_path(devs[i]),
+ *			       liblsusb_device_vendor_id(devs[i]),
+ *			       liblsusb_device_product_id(devs[i]),
+ *			       liblsusb_device_product(devs[i]));
+ *		liblsusb_free_devices(devs);
+ *	}
+ *	liblsusb_free(ctx);
+ *
+ * All records are opaque and only reachable through the functions below,
+ * so that fields can be added without breaking callers.  The name
+ * database is shared by the whole process: create one context and use it
+ * from one thread at a time.
+ */
+
+#ifndef _LIBLSUSB_H
+#define _LIBLSUSB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct liblsusb;
+struct liblsusb_device;
+struct liblsusb_config;
+struct liblsusb_interface;
+struct liblsusb_endpoint;
+
+/* Returns 0, or a negative libusb error code. */
+extern int liblsusb_new(struct liblsusb **ctx);
+extern void liblsusb_free(struct liblsusb *ctx);
+
+/*
+ * All devices, hubs before the devices behind them, as a NULL terminated
+ * list.  Returns the number of devices, or a negative libusb error code.
+ */
+extern ssize_t liblsusb_get_devices(struct liblsusb *ctx,
+				    struct liblsusb_device ***devices);
+extern void liblsusb_free_devices(struct liblsusb_device **devices);
+
+/* The hub a device is connected to, from the same list; NULL for root hubs. */
+extern struct liblsusb_device *liblsusb_device_parent(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_busnum(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_devnum(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_depth(const struct liblsusb_device *dev);
+/* The sysfs name: "usb1" for a root hub, "1-2.3" behind it. */
+extern const char *liblsusb_device_path(const struct liblsusb_device *dev);
+/* kbit/s, 0 if unknown */
+extern unsigned int liblsusb_device_speed(const struct liblsusb_device *dev);
+
+/* The device descriptor. */
+extern uint16_t liblsusb_device_bcd_usb(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_class(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_subclass(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_protocol(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_max_packet_size0(const struct liblsusb_device *dev);
+extern uint16_t liblsusb_device_vendor_id(const struct liblsusb_device *dev);
+extern uint16_t liblsusb_device_product_id(const struct liblsusb_device *dev);
+extern uint16_t liblsusb_device_bcd_device(const struct liblsusb_device *dev);
+extern uint8_t liblsusb_device_num_configurations(const struct liblsusb_device *dev);
+
+/*
+ * Vendor and product from the hwdb or usb.ids, else the strings the
+ * device reported; the serial number.  Empty strings if unknown.
+ */
+extern const char *liblsusb_device_vendor(const struct liblsusb_device *dev);
+extern const char *liblsusb_device_product(const struct liblsusb_device *dev);
+extern const char *liblsusb_device_serial(const struct liblsusb_device *dev);
+
+/* The active configuration of a device from the list.  Returns 0 or < 0. */
+extern int liblsusb_get_active_config(struct liblsusb *ctx,
+				      const struct liblsusb_device *dev,
+				      struct liblsusb_config **config);
+extern void liblsusb_free_config(struct liblsusb_config *config);
+
+extern uint8_t liblsusb_config_value(const struct liblsusb_config *config);
+extern uint8_t liblsusb_config_attributes(const struct liblsusb_config *config);
+/* mA */
+extern unsigned int liblsusb_config_max_power(const struct liblsusb_config *config);
+extern uint8_t liblsusb_config_num_interfaces(const struct liblsusb_config *config);
+/* Every alternate setting of every interface; NULL past the last one. */
+extern size_t liblsusb_config_num_altsettings(const struct liblsusb_config *config);
+extern const struct liblsusb_interface *
+liblsusb_config_altsetting(const struct liblsusb_config *config, size_t i);
+
+extern uint8_t liblsusb_interface_number(const struct liblsusb_interface *intf);
+extern uint8_t liblsusb_interface_alt_setting(const struct liblsusb_interface *intf);
+extern uint8_t liblsusb_interface_class(const struct liblsusb_interface *intf);
+extern uint8_t liblsusb_interface_subclass(const struct liblsusb_interface *intf);
+extern uint8_t liblsusb_interface_protocol(const struct liblsusb_interface *intf);
+/* The bound kernel driver, empty if none. */
+extern const char *liblsusb_interface_driver(const struct liblsusb_interface *intf);
+extern size_t liblsusb_interface_num_endpoints(const struct liblsusb_interface *intf);
+extern const struct liblsusb_endpoint *
+liblsusb_interface_endpoint(const struct liblsusb_interface *intf, size_t i);
+
+/* bit 7 set for IN */
+extern uint8_t liblsusb_endpoint_address(const struct liblsusb_endpoint *ep);
+/* bits 0-1 the transfer type */
+extern uint8_t liblsusb_endpoint_attributes(const struct liblsusb_endpoint *ep);
+/* wMaxPacketSize, including bits 11-12 */
+extern uint16_t liblsusb_endpoint_max_packet_size(const struct liblsusb_endpoint *ep);
+extern uint8_t liblsusb_endpoint_interval(const struct liblsusb_endpoint *ep);
+
+/* Names from the hwdb or usb.ids, NULL if unknown. */
+extern const char *liblsusb_vendor_name(struct liblsusb *ctx, uint16_t vendor_id);
+extern const char *liblsusb_product_name(struct liblsusb *ctx, uint16_t vendor_id,
+					 uint16_t product_id);
+extern const char *liblsusb_class_name(struct liblsusb *ctx, uint8_t class_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LIBLSUSB_H */
@@ -0,0 +1,512 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Offline usbmon capture analysis for lsusb
+ *
+ * Submissions are matched with their completions by URB tag, and every
+ * endpoint gets its throughput and log scale histograms of URB size and
+ * submit to complete latency.  Memory use is fixed whatever the size of
+ * the capture.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "names.h"
+#include "usbmon.h"
+#include "bandwidth.h"
+
+#define MAX_ANALYZE_EPS		512
+#define MAX_ANALYZE_DEVS	256
+#define PENDING_SLOTS		65536	/* power of 2 */
+
+/*
+ * Histogram buckets: values below 16 exactly, above that 8 buckets per
+ * power of 2 (12.5% resolution), up to 2^40.
+ */
+#define HIST_SUB_BITS		3
+#define HIST_LINEAR		16
+#define HIST_MAX_EXP		40
+#define HIST_BUCKETS		(HIST_LINEAR + (HIST_MAX_EXP - 4 + 1) * 8)
+
+struct hist {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint32_t bucket[HIST_BUCKETS];
+};
+
+struct ep_stats {
+	uint16_t busnum;
+	uint8_t devnum;
+	uint8_t epnum;
+	uint8_t xfer_type;
+	uint64_t urbs;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t unmatched;		/* completions without a submission */
+	uint64_t first;
+	uint64_t last;
+	struct hist size;
+	struct hist latency;
+};
+
+struct dev_label {
+	uint16_t busnum;
+	uint8_t devnum;
+	uint8_t valid;
+	uint16_t vendor;
+	uint16_t product;
+	/* interface class per endpoint, from a captured config descriptor */
+	uint8_t has_config;
+	uint8_t ep_ifnum[32];
+	uint8_t ep_class[32];
+	uint8_t ep_known[32];
+};
+
+struct pending {
+	uint64_t id;
+	uint64_t ts;
+	uint16_t busnum;
+	uint8_t used;
+};
+
+struct analyze {
+	struct ep_stats *eps[MAX_ANALYZE_EPS];
+	unsigned int neps;
+	struct dev_label devs[MAX_ANALYZE_DEVS];
+	unsigned int ndevs;
+	struct pending pending[PENDING_SLOTS];
+	unsigned int npending;
+	uint64_t events;
+	uint64_t dropped;		/* submissions not tracked, table full */
+	uint64_t first;
+	uint64_t last;
+};
+
+/* ---------------------------------------------------------------------- */
+
+static unsigned int hist_index(uint64_t v)
+{
+	unsigned int e;
+
+	if (v < HIST_LINEAR)
+		return v;
+	e = 63 - __builtin_clzll(v);
+	if (e > HIST_MAX_EXP)
+		return HIST_BUCKETS - 1;
+	return HIST_LINEAR + (e - 4) * 8 +
+		((v >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+/* lowest value that falls into bucket i */
+static uint64_t hist_value(unsigned int i)
+{
+	unsigned int e, sub;
+
+	if (i < HIST_LINEAR)
+		return i;
+	e = (i - HIST_LINEAR) / 8 + 4;
+	sub = (i - HIST_LINEAR) % 8;
+	return (uint64_t)(8 + sub) << (e - HIST_SUB_BITS);
+}
+
+static void hist_add(struct hist *h, uint64_t v)
+{
+	if (!h->count || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->count++;
+	h->bucket[hist_index(v)]++;
+}
+
+/* per mille, 500 for the median */
+static uint64_t hist_percentile(const struct hist *h, unsigned int pm)
+{
+	uint64_t want = (h->count * pm + 999) / 1000, seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen >= want && seen)
+			return hist_value(i) > h->min ? hist_value(i) : h->min;
+	}
+	return h->max;
+}
+
+static void hist_print(const char *name, const char *unit, const struct hist *h)
+{
+	printf("    %-13s min %llu, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu %s\n",
+	       name, (unsigned long long)h->min,
+	       (unsigned long long)hist_percentile(h, 500),
+	       (unsigned long long)hist_percentile(h, 900),
+	       (unsigned long long)hist_percentile(h, 990),
+	       (unsigned long long)hist_percentile(h, 999),
+	       (unsigned long long)h->max, unit);
+}
+
+static void hist_dump(const struct hist *h)
+{
+	uint32_t top = 0;
+	unsigned int i, bar;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		if (h->bucket[i] > top)
+			top = h->bucket[i];
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (!h->bucket[i])
+			continue;
+		bar = (uint64_t)h->bucket[i] * 40 / top;
+		printf("      %12llu .. %-12llu %10u %.*s\n",
+		       (unsigned long long)hist_value(i),
+		       (unsigned long long)(i + 1 < HIST_BUCKETS ?
+					    hist_value(i + 1) - 1 : h->max),
+		       h->bucket[i], bar ? bar : 1,
+		       "########################################");
+	}
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* linear probing with backward shift deletion, so no tombstones */
+static unsigned int pending_hash(uint64_t id)
+{
+	return ((id ^ (id >> 29)) * 0x9e3779b97f4a7c15ULL >> 48) & (PENDING_SLOTS - 1);
+}
+
+static void pending_add(struct analyze *a, const struct usbmon_event *ev)
+{
+	unsigned int i = pending_hash(ev->id);
+
+	if (a->npending == PENDING_SLOTS - 1) {
+		a->dropped++;
+		return;
+	}
+	while (a->pending[i].used) {
+		/* resubmitted before we saw it complete: restart the clock */
+		if (a->pending[i].id == ev->id && a->pending[i].busnum == ev->busnum)
+			break;
+		i = (i + 1) & (PENDING_SLOTS - 1);
+	}
+	if (!a->pending[i].used)
+		a->npending++;
+	a->pending[i].id = ev->id;
+	a->pending[i].busnum = ev->busnum;
+	a->pending[i].ts = ev->ts_usec;
+	a->pending[i].used = 1;
+}
+
+/* returns the submission time, or 0 if the URB was not seen submitted */
+static uint64_t pending_take(struct analyze *a, const struct usbmon_event *ev)
+{
+	unsigned int i = pending_hash(ev->id), j, home;
+	uint64_t ts;
+
+	while (a->pending[i].used && (a->pending[i].id != ev->id ||
+				      a->pending[i].busnum != ev->busnum))
+		i = (i + 1) & (PENDING_SLOTS - 1);
+	if (!a->pending[i].used)
+		return 0;
+	ts = a->pending[i].ts;
+	a->npending--;
+
+	/* move later entries of the same probe run back into the hole */
+	for (j = (i + 1) & (PENDING_SLOTS - 1); a->pending[j].used;
+	     j = (j + 1) & (PENDING_SLOTS - 1)) {
+		home = pending_hash(a->pending[j].id);
+		if (((j - home) & (PENDING_SLOTS - 1)) >=
+		    ((j - i) & (PENDING_SLOTS - 1))) {
+			a->pending[i] = a->pending[j];
+			i = j;
+		}
+	}
+	a->pending[i].used = 0;
+	return ts ? ts : 1;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static struct dev_label *find_dev(struct analyze *a, uint16_t bus, uint8_t dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < a->ndevs; i++)
+		if (a->devs[i].busnum == bus && a->devs[i].devnum == dev)
+			return &a->devs[i];
+	if (a->ndevs == MAX_ANALYZE_DEVS)
+		return NULL;
+	a->devs[a->ndevs].busnum = bus;
+	a->devs[a->ndevs].devnum = dev;
+	return &a->devs[a->ndevs++];
+}
+
+static unsigned int ep_slot(uint8_t epnum)
+{
+	return (epnum & 0x0f) | (epnum & 0x80 ? 0x10 : 0);
+}
+
+/* a completed GET_DESCRIPTOR(CONFIGURATION) tells which interface owns what */
+static void config_from_trace(struct analyze *a, const struct usbmon_event *ev)
+{
+	const unsigned char *d = ev->data;
+	unsigned int len, pos, ifnum = 0, ifclass = 0;
+	struct dev_label *l;
+
+	if (ev->type != 'C' || ev->xfer_type != USBMON_CTRL || ev->epnum != 0x80 ||
+	    ev->len_cap < 9 || d[0] != 9 || d[1] != LIBUSB_DT_CONFIG)
+		return;
+	len = d[2] | (d[3] << 8);
+	if (len > ev->len_cap)
+		return;		/* just the 9 byte header */
+	l = find_dev(a, ev->busnum, ev->devnum);
+	if (!l)
+		return;
+	memset(l->ep_known, 0, sizeof(l->ep_known));
+	for (pos = 0; pos + 2 <= len && d[pos] >= 2; pos += d[pos]) {
+		if (d[pos + 1] == LIBUSB_DT_INTERFACE && d[pos] >= 9 && pos + 9 <= len) {
+			ifnum = d[pos + 2];
+			ifclass = d[pos + 5];
+		} else if (d[pos + 1] == LIBUSB_DT_ENDPOINT && d[pos] >= 7 &&
+			   pos + 7 <= len) {
+			l->ep_ifnum[ep_slot(d[pos + 2])] = ifnum;
+			l->ep_class[ep_slot(d[pos + 2])] = ifclass;
+			l->ep_known[ep_slot(d[pos + 2])] = 1;
+		}
+	}
+	l->has_config = 1;
+}
+
+static struct ep_stats *find_ep(struct analyze *a, const struct usbmon_event *ev)
+{
+	struct ep_stats *s;
+	unsigned int i;
+
+	for (i = 0; i < a->neps; i++) {
+		s = a->eps[i];
+		if (s->busnum == ev->busnum && s->devnum == ev->devnum &&
+		    s->epnum == ev->epnum)
+			return s;
+	}
+	if (a->neps == MAX_ANALYZE_EPS)
+		return NULL;
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->busnum = ev->busnum;
+	s->devnum = ev->devnum;
+	s->epnum = ev->epnum;
+	s->xfer_type = ev->xfer_type;
+	s->first = ev->ts_usec;
+	a->eps[a->neps++] = s;
+	return s;
+}
+
+static int analyze_event(const struct usbmon_event *ev, void *data)
+{
+	struct analyze *a = data;
+	struct dev_label *l;
+	struct ep_stats *s;
+	uint16_t vendor, product;
+	uint64_t submitted;
+
+	if (!a->events++)
+		a->first = ev->ts_usec;
+	a->last = ev->ts_usec;
+
+	if (ev->type == 'S') {
+		pending_add(a, ev);
+		return 0;
+	}
+
+	if (!usbmon_device_ids(ev, &vendor, &product)) {
+		l = find_dev(a, ev->busnum, ev->devnum);
+		if (l) {
+			l->vendor = vendor;
+			l->product = product;
+			l->valid = 1;
+		}
+	}
+	config_from_trace(a, ev);
+
+	submitted = pending_take(a, ev);
+	s = find_ep(a, ev);
+	if (!s)
+		return 0;
+	s->last = ev->ts_usec;
+	s->urbs++;
+	if (ev->type == 'E' || ev->status < 0)
+		s->errors++;
+	if (ev->type == 'E')
+		return 0;
+	s->bytes += ev->length;
+	hist_add(&s->size, ev->length);
+	if (submitted)
+		hist_add(&s->latency, ev->ts_usec >= submitted ?
+			 ev->ts_usec - submitted : 0);
+	else
+		s->unmatched++;
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* devices that did not enumerate within the capture are looked up live */
+static void label_from_bus(struct analyze *a, libusb_context *ctx)
+{
+	struct libusb_device_descriptor desc;
+	struct dev_label *l;
+	libusb_device **list;
+	ssize_t n, i;
+	unsigned int j;
+
+	for (j = 0; j < a->ndevs; j++)
+		if (!a->devs[j].valid)
+			break;
+	if (j == a->ndevs || !ctx)
+		return;
+
+	n = libusb_get_device_list(ctx, &list);
+	if (n < 0)
+		return;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < a->ndevs; j++) {
+			l = &a->devs[j];
+			if (l->valid || l->busnum != libusb_get_bus_number(list[i]) ||
+			    l->devnum != libusb_get_device_address(list[i]))
+				continue;
+			if (libusb_get_device_descriptor(list[i], &desc))
+				continue;
+			l->vendor = desc.idVendor;
+			l->product = desc.idProduct;
+			l->valid = 1;
+		}
+	}
+	libusb_free_device_list(list, 1);
+}
+
+static int cmp_eps(const void *a, const void *b)
+{
+	const struct ep_stats *ea = *(const struct ep_stats * const *)a;
+	const struct ep_stats *eb = *(const struct ep_stats * const *)b;
+
+	if (ea->busnum != eb->busnum)
+		return ea->busnum - eb->busnum;
+	if (ea->devnum != eb->devnum)
+		return ea->devnum - eb->devnum;
+	return (ea->epnum & 0x0f) != (eb->epnum & 0x0f) ?
+		(ea->epnum & 0x0f) - (eb->epnum & 0x0f) : ea->epnum - eb->epnum;
+}
+
+static void print_device(const struct dev_label *l, uint16_t bus, uint8_t dev)
+{
+	const char *vendor, *product;
+
+	printf("\nBus %03u Device %03u:", bus, dev);
+	if (!l || !l->valid) {
+		printf(" ID ????:????\n");
+		return;
+	}
+	vendor = names_vendor(l->vendor);
+	product = names_product(l->vendor, l->product);
+	printf(" ID %04x:%04x %s %s\n", l->vendor, l->product,
+	       vendor ? vendor : "", product ? product : "");
+}
+
+static void print_ep(const struct ep_stats *s, const struct dev_label *l)
+{
+	static const char * const types[] = { "Isoc", "Intr", "Ctrl", "Bulk" };
+	unsigned int slot = ep_slot(s->epnum);
+	uint64_t span = s->last - s->first;
+	char rate[32];
+	const char *cls;
+
+	printf("  EP 0x%02x %s %s", s->epnum, types[s->xfer_type & 3],
+	       s->epnum & 0x80 ? "IN" : "OUT");
+	if (l && l->has_config && l->ep_known[slot]) {
+		cls = names_class(l->ep_class[slot]);
+		printf(", interface %u (%s)", l->ep_ifnum[slot],
+		       cls ? cls : "unknown class");
+	}
+	printf("\n    %llu URBs, %llu bytes in %llu.%06llu s",
+	       (unsigned long long)s->urbs, (unsigned long long)s->bytes,
+	       (unsigned long long)(span / 1000000),
+	       (unsigned long long)(span % 1000000));
+	if (span)
+		printf(", %s", bw_format_rate(rate, sizeof(rate),
+					      s->bytes * 1000000 / span));
+	if (s->errors)
+		printf(", %llu errors", (unsigned long long)s->errors);
+	if (s->unmatched)
+		printf(", %llu not seen submitted", (unsigned long long)s->unmatched);
+	printf("\n");
+
+	if (s->size.count) {
+		hist_print("URB size", "bytes", &s->size);
+		if (verblevel > 0)
+			hist_dump(&s->size);
+	}
+	if (s->latency.count) {
+		hist_print("latency", "us", &s->latency);
+		if (verblevel > 0)
+			hist_dump(&s->latency);
+	}
+}
+
+/*
+ * Summarize a usbmon pcap capture per endpoint.  Devices are named from
+ * descriptors in the capture, or from the devices now connected.
+ */
+int lsusb_analyze(libusb_context *ctx, const char *capture)
+{
+	struct analyze *a;
+	struct ep_stats *s;
+	uint64_t span;
+	unsigned int i;
+	int ret;
+
+	a = calloc(1, sizeof(*a));
+	if (!a)
+		return 1;
+	ret = usbmon_read_pcap(capture, analyze_event, a) ? 1 : 0;
+	if (ret)
+		goto out;
+
+	span = a->last - a->first;
+	printf("%s: %llu events over %llu.%06llu s, %u URBs still pending at the end\n",
+	       capture, (unsigned long long)a->events,
+	       (unsigned long long)(span / 1000000),
+	       (unsigned long long)(span % 1000000), a->npending);
+	if (a->dropped)
+		printf("%llu submissions not tracked, more than %u URBs in flight\n",
+		       (unsigned long long)a->dropped, PENDING_SLOTS - 1);
+	if (a->neps == MAX_ANALYZE_EPS)
+		printf("only the first %u endpoints are shown\n", MAX_ANALYZE_EPS);
+
+	label_from_bus(a, ctx);
+	qsort(a->eps, a->neps, sizeof(a->eps[0]), cmp_eps);
+	for (i = 0; i < a->neps; i++) {
+		struct dev_label *l = NULL;
+		unsigned int j;
+
+		s = a->eps[i];
+		for (j = 0; j < a->ndevs; j++)
+			if (a->devs[j].busnum == s->busnum &&
+			    a->devs[j].devnum == s->devnum)
+				l = &a->devs[j];
+		if (!i || s->busnum != a->eps[i - 1]->busnum ||
+		    s->devnum != a->eps[i - 1]->devnum)
+			print_device(l, s->busnum, s->devnum);
+		print_ep(s, l);
+	}
+out:
+	for (i = 0; i < a->neps; i++)
+		free(a->eps[i]);
+	free(a);
+	return ret;
+}
@@ -0,0 +1,546 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * USB Audio streaming mode reports for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+#include "bandwidth.h"
+
+#define USB_DT_CS_INTERFACE		0x24
+
+#define USB_AUDIO_CLASS_1		0x00
+#define USB_AUDIO_CLASS_2		0x20
+#define USB_AUDIO_CLASS_3		0x30
+
+/* AudioControl clock entity subtypes */
+#define UAC2_CLOCK_SOURCE		0x0a
+#define UAC2_CLOCK_SELECTOR		0x0b
+#define UAC2_CLOCK_MULTIPLIER		0x0c
+#define UAC3_CLOCK_SOURCE		0x0b
+#define UAC3_CLOCK_SELECTOR		0x0c
+#define UAC3_CLOCK_MULTIPLIER		0x0d
+
+/* UAC2/UAC3 class requests and clock control selectors */
+#define UAC2_CUR			0x01
+#define UAC2_RANGE			0x02
+#define UAC2_CS_SAM_FREQ_CONTROL	0x01
+#define UAC2_CS_CLOCK_VALID_CONTROL	0x02
+#define UAC2_CX_CLOCK_SELECTOR_CONTROL	0x01
+#define UAC2_CM_NUMERATOR_CONTROL	0x01
+#define UAC2_CM_DENOMINATOR_CONTROL	0x02
+
+/* AudioStreaming interface descriptor subtypes */
+#define UAC_AS_GENERAL			0x01
+#define UAC_FORMAT_TYPE			0x02
+
+#define UAC_FORMAT_TYPE_I		0x01
+#define UAC_FORMAT_TYPE_III		0x03
+
+#define MAX_RATES			32
+#define MAX_SUBRANGES			16
+
+/* rates tried when the descriptors do not list any (UAC2 and UAC3) */
+static const unsigned int common_rates[] = {
+	8000, 16000, 32000, 44100, 48000, 88200, 96000,
+	176400, 192000, 352800, 384000,
+};
+
+struct as_format {
+	unsigned int channels;		/* 0 if not in the descriptors */
+	unsigned int subslot;		/* bytes per sample per channel */
+	unsigned int bits;
+	unsigned int nrates;
+	unsigned int rates[MAX_RATES];
+	int continuous;			/* rates[0]..rates[1] */
+	int assumed;			/* rates[] are common_rates */
+};
+
+enum clock_type {
+	CLOCK_NONE,
+	CLOCK_SOURCE,
+	CLOCK_SELECTOR,
+	CLOCK_MULTIPLIER,
+};
+
+/* result of a clock control request; ret is the libusb status */
+struct clock_value {
+	int ret;
+	unsigned int value;
+};
+
+struct clock_entity {
+	enum clock_type type;
+	struct clock_value freq;
+	struct clock_value valid;
+	struct clock_value pin;
+	struct clock_value numerator;
+	struct clock_value denominator;
+	int range_ret;
+	unsigned int nranges;
+	unsigned int ranges[MAX_SUBRANGES][3];	/* min, max, res */
+};
+
+/* indexed by bClockID; filled by audio_clock_query() */
+static struct clock_entity clocks[256];
+static int clocks_unavailable;
+
+/* ---------------------------------------------------------------------- */
+
+static unsigned int le_u24(const unsigned char *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16);
+}
+
+static const char *uac_name(int protocol)
+{
+	switch (protocol) {
+	case USB_AUDIO_CLASS_1:
+		return "UAC1";
+	case USB_AUDIO_CLASS_2:
+		return "UAC2";
+	case USB_AUDIO_CLASS_3:
+		return "UAC3";
+	default:
+		return "UAC?";
+	}
+}
+
+static void parse_uac1_format(struct as_format *f, const unsigned char *buf)
+{
+	unsigned int i, n;
+
+	if (buf[0] < 8 || (buf[3] != UAC_FORMAT_TYPE_I && buf[3] != UAC_FORMAT_TYPE_III))
+		return;
+	f->channels = buf[4];
+	f->subslot = buf[5];
+	f->bits = buf[6];
+	n = buf[7];
+	if (!n) {
+		if (buf[0] < 14)
+			return;
+		f->continuous = 1;
+		f->nrates = 2;
+		f->rates[0] = le_u24(buf + 8);
+		f->rates[1] = le_u24(buf + 11);
+		return;
+	}
+	for (i = 0; i < n && i < MAX_RATES && 8 + 3 * i + 3 <= buf[0]; i++)
+		f->rates[i] = le_u24(buf + 8 + 3 * i);
+	f->nrates = i;
+}
+
+/*
+ * Gather channels, sample size and sample rates of one alt setting from
+ * its class-specific AudioStreaming descriptors.
+ */
+static int parse_as_format(const struct libusb_interface_descriptor *as,
+			   int protocol, struct as_format *f)
+{
+	const unsigned char *buf = as->extra;
+	int size = as->extra_length;
+	unsigned int i;
+
+	memset(f, 0, sizeof(*f));
+	while (buf && size >= 3) {
+		if (buf[0] < 3 || buf[0] > size)
+			break;
+		if (buf[1] != USB_DT_CS_INTERFACE)
+			goto next;
+
+		switch (protocol) {
+		case USB_AUDIO_CLASS_1:
+			if (buf[2] == UAC_FORMAT_TYPE)
+				parse_uac1_format(f, buf);
+			break;
+		case USB_AUDIO_CLASS_2:
+			if (buf[2] == UAC_AS_GENERAL && buf[0] >= 11)
+				f->channels = buf[10];
+			else if (buf[2] == UAC_FORMAT_TYPE && buf[0] >= 6 &&
+				 (buf[3] == UAC_FORMAT_TYPE_I ||
+				  buf[3] == UAC_FORMAT_TYPE_III)) {
+				f->subslot = buf[4];
+				f->bits = buf[5];
+			}
+			break;
+		case USB_AUDIO_CLASS_3:
+			/* channels live in the cluster descriptor */
+			if (buf[2] == UAC_AS_GENERAL && buf[0] >= 20) {
+				f->subslot = buf[18];
+				f->bits = buf[19];
+			}
+			break;
+		}
+next:
+		size -= buf[0];
+		buf += buf[0];
+	}
+
+	if (!f->subslot)
+		return -1;
+	if (!f->nrates) {
+		for (i = 0; i < sizeof(common_rates) / sizeof(common_rates[0]); i++)
+			f->rates[i] = common_rates[i];
+		f->nrates = i;
+		f->assumed = 1;
+	}
+	return 0;
+}
+
+static const struct libusb_endpoint_descriptor *
+find_data_ep(const struct libusb_interface_descriptor *as)
+{
+	int i;
+
+	for (i = 0; i < as->bNumEndpoints; i++) {
+		const struct libusb_endpoint_descriptor *ep = &as->endpoint[i];
+
+		if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) !=
+		    LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+			continue;
+		/* skip explicit feedback endpoints */
+		if (((ep->bmAttributes >> 4) & 3) == 1)
+			continue;
+		return ep;
+	}
+	return NULL;
+}
+
+/*
+ * Largest packet one service interval needs at this rate.  Asynchronous
+ * and adaptive endpoints may have to carry one extra sample frame to
+ * follow their clock.
+ */
+static unsigned int bytes_per_interval(const struct libusb_endpoint_descriptor *ep,
+				       int speed, unsigned int rate,
+				       unsigned int frame_bytes)
+{
+	unsigned long long per_sec = bw_intervals_per_second(speed);
+	unsigned long long n;
+	unsigned int sync = (ep->bmAttributes >> 2) & 3;
+
+	n = ((unsigned long long)rate * bw_ep_interval(ep, speed) + per_sec - 1) / per_sec;
+	if (sync == 1 || sync == 2)
+		n++;
+	return n * frame_bytes;
+}
+
+static void print_rate(const struct libusb_interface_descriptor *as,
+		       const struct libusb_endpoint_descriptor *ep, int speed,
+		       const struct as_format *f, unsigned int rate)
+{
+	unsigned int max = bw_ep_bytes_per_interval(ep, speed);
+	unsigned int need;
+
+	printf("    %3u  0x%02x ", as->bAlternateSetting, ep->bEndpointAddress);
+	if (f->channels) {
+		need = bytes_per_interval(ep, speed, rate, f->channels * f->subslot);
+		printf("%4u %4u %7u %9u %14u %10u  %s\n",
+		       f->channels, f->bits, f->subslot, rate, need, max,
+		       need <= max ? "yes" : "NO");
+	} else {
+		/* without a channel count, show how many would fit */
+		need = bytes_per_interval(ep, speed, rate, f->subslot);
+		printf("%4s %4u %7u %9u %14u %10u  max %u channels\n",
+		       "?", f->bits, f->subslot, rate, need, max,
+		       need ? max / need : 0);
+	}
+}
+
+static void do_as_interface(const struct libusb_interface *intf, int speed)
+{
+	const struct libusb_interface_descriptor *as0 = &intf->altsetting[0];
+	int protocol = as0->bInterfaceProtocol;
+	struct as_format f;
+	int i, assumed = 0;
+	unsigned int j;
+
+	printf("  AudioStreaming Interface %u (%s, %s):\n",
+	       as0->bInterfaceNumber, uac_name(protocol), bw_speed_name(speed));
+	printf("    %3s  %-4s %4s %4s %7s %9s %14s %10s  %s\n",
+	       "Alt", "EP", "Ch", "Bits", "Subslot", "Rate",
+	       "Bytes/interval", "MaxPacket", "Fits");
+
+	for (i = 0; i < intf->num_altsetting; i++) {
+		const struct libusb_interface_descriptor *as = &intf->altsetting[i];
+		const struct libusb_endpoint_descriptor *ep = find_data_ep(as);
+
+		if (!ep || parse_as_format(as, protocol, &f))
+			continue;
+		assumed |= f.assumed;
+		if (f.continuous) {
+			print_rate(as, ep, speed, &f, f.rates[0]);
+			print_rate(as, ep, speed, &f, f.rates[1]);
+			continue;
+		}
+		for (j = 0; j < f.nrates; j++)
+			print_rate(as, ep, speed, &f, f.rates[j]);
+	}
+	if (assumed)
+		printf("    (%s descriptors carry no sample rates; common rates shown)\n",
+		       uac_name(protocol));
+}
+
+int lsusb_audio_modes(libusb_device *dev)
+{
+	struct libusb_config_descriptor *config;
+	int speed = libusb_get_device_speed(dev);
+	int i;
+
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return 1;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		if (intf->num_altsetting < 1)
+			continue;
+		if (intf->altsetting[0].bInterfaceClass != LIBUSB_CLASS_AUDIO ||
+		    intf->altsetting[0].bInterfaceSubClass != 2)
+			continue;
+		do_as_interface(intf, speed);
+	}
+
+	libusb_free_config_descriptor(config);
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int clock_request(libusb_device_handle *udev, uint8_t request,
+			 unsigned int cs, unsigned int id, unsigned int ifnum,
+			 unsigned char *buf, unsigned int len)
+{
+	return libusb_control_transfer(udev,
+			LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
+				LIBUSB_RECIPIENT_INTERFACE,
+			request, cs << 8, (id << 8) | ifnum,
+			buf, len, CTRL_TIMEOUT);
+}
+
+static void clock_cur(libusb_device_handle *udev, unsigned int cs,
+		      unsigned int id, unsigned int ifnum, unsigned int len,
+		      struct clock_value *v)
+{
+	unsigned char buf[4];
+
+	memset(buf, 0, sizeof(buf));
+	v->ret = clock_request(udev, UAC2_CUR, cs, id, ifnum, buf, len);
+	if (v->ret == (int)len)
+		v->value = len == 4 ? convert_le_u32(buf) : len == 2 ? convert_le_u16(buf) : buf[0];
+	else if (v->ret >= 0)
+		v->ret = LIBUSB_ERROR_IO;
+}
+
+static void clock_freq_range(libusb_device_handle *udev, unsigned int id,
+			     unsigned int ifnum, struct clock_entity *c)
+{
+	unsigned char buf[2 + 12 * MAX_SUBRANGES];
+	unsigned int n, i;
+	int ret;
+
+	/* the subrange count first, as some devices stall on long reads */
+	ret = clock_request(udev, UAC2_RANGE, UAC2_CS_SAM_FREQ_CONTROL, id, ifnum,
+			    buf, 2);
+	if (ret == 2) {
+		n = convert_le_u16(buf);
+		if (n > MAX_SUBRANGES)
+			n = MAX_SUBRANGES;
+		ret = clock_request(udev, UAC2_RANGE, UAC2_CS_SAM_FREQ_CONTROL, id,
+				    ifnum, buf, 2 + 12 * n);
+		if (ret >= 2) {
+			n = (ret - 2) / 12;
+			for (i = 0; i < n; i++) {
+				c->ranges[i][0] = convert_le_u32(buf + 2 + 12 * i);
+				c->ranges[i][1] = convert_le_u32(buf + 6 + 12 * i);
+				c->ranges[i][2] = convert_le_u32(buf + 10 + 12 * i);
+			}
+			c->nranges = n;
+		}
+	}
+	c->range_ret = ret < 0 ? ret : 0;
+}
+
+/* is a UAC2 (2 bit) / UAC3 (2 bit, 32 bit wide) control present? */
+static int has_control(unsigned int bmcontrols, unsigned int n)
+{
+	return (bmcontrols >> (2 * n)) & 3;
+}
+
+static void query_clock(libusb_device_handle *udev, const unsigned char *buf,
+			int protocol, unsigned int ifnum)
+{
+	unsigned int id = buf[3];
+	unsigned int bmcontrols;
+	struct clock_entity *c = &clocks[id];
+	int uac3 = protocol == USB_AUDIO_CLASS_3;
+	enum clock_type type = CLOCK_NONE;
+
+	if (uac3) {
+		if (buf[2] == UAC3_CLOCK_SOURCE)
+			type = CLOCK_SOURCE;
+		else if (buf[2] == UAC3_CLOCK_SELECTOR)
+			type = CLOCK_SELECTOR;
+		else if (buf[2] == UAC3_CLOCK_MULTIPLIER)
+			type = CLOCK_MULTIPLIER;
+	} else {
+		if (buf[2] == UAC2_CLOCK_SOURCE)
+			type = CLOCK_SOURCE;
+		else if (buf[2] == UAC2_CLOCK_SELECTOR)
+			type = CLOCK_SELECTOR;
+		else if (buf[2] == UAC2_CLOCK_MULTIPLIER)
+			type = CLOCK_MULTIPLIER;
+	}
+
+	switch (type) {
+	case CLOCK_SOURCE:
+		if (buf[0] < (uac3 ? 12 : 8))
+			return;
+		c->type = CLOCK_SOURCE;
+		bmcontrols = uac3 ? convert_le_u32(buf + 5) : buf[5];
+		if (has_control(bmcontrols, 0)) {
+			clock_cur(udev, UAC2_CS_SAM_FREQ_CONTROL, id, ifnum, 4, &c->freq);
+			clock_freq_range(udev, id, ifnum, c);
+		} else {
+			c->freq.ret = c->range_ret = LIBUSB_ERROR_NOT_SUPPORTED;
+		}
+		if (has_control(bmcontrols, 1))
+			clock_cur(udev, UAC2_CS_CLOCK_VALID_CONTROL, id, ifnum, 1, &c->valid);
+		else
+			c->valid.ret = LIBUSB_ERROR_NOT_SUPPORTED;
+		break;
+	case CLOCK_SELECTOR:
+		if (buf[0] < (uac3 ? 11 : 7) + buf[4])
+			return;
+		c->type = CLOCK_SELECTOR;
+		clock_cur(udev, UAC2_CX_CLOCK_SELECTOR_CONTROL, id, ifnum, 1, &c->pin);
+		break;
+	case CLOCK_MULTIPLIER:
+		if (buf[0] < (uac3 ? 11 : 7))
+			return;
+		c->type = CLOCK_MULTIPLIER;
+		bmcontrols = uac3 ? convert_le_u32(buf + 5) : buf[5];
+		if (has_control(bmcontrols, 0))
+			clock_cur(udev, UAC2_CM_NUMERATOR_CONTROL, id, ifnum, 2, &c->numerator);
+		else
+			c->numerator.ret = LIBUSB_ERROR_NOT_SUPPORTED;
+		if (has_control(bmcontrols, 1))
+			clock_cur(udev, UAC2_CM_DENOMINATOR_CONTROL, id, ifnum, 2, &c->denominator);
+		else
+			c->denominator.ret = LIBUSB_ERROR_NOT_SUPPORTED;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Read the current state and sampling frequency ranges of every clock
+ * source, selector and multiplier of the configuration, claiming each
+ * AudioControl interface only once.  The results are printed next to the
+ * clock entity descriptors by audio_clock_dump().
+ */
+int audio_clock_query(libusb_device_handle *udev,
+		      const struct libusb_config_descriptor *config)
+{
+	int i;
+
+	memset(clocks, 0, sizeof(clocks));
+	clocks_unavailable = 0;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface_descriptor *ac;
+		const unsigned char *buf;
+		int size;
+
+		if (config->interface[i].num_altsetting < 1)
+			continue;
+		ac = &config->interface[i].altsetting[0];
+		if (ac->bInterfaceClass != LIBUSB_CLASS_AUDIO ||
+		    ac->bInterfaceSubClass != 1 ||
+		    (ac->bInterfaceProtocol != USB_AUDIO_CLASS_2 &&
+		     ac->bInterfaceProtocol != USB_AUDIO_CLASS_3))
+			continue;
+
+		/* recent Linuxes require claim() for RECIP_INTERFACE */
+		if (libusb_claim_interface(udev, ac->bInterfaceNumber)) {
+			clocks_unavailable = 1;
+			continue;
+		}
+		buf = ac->extra;
+		size = ac->extra_length;
+		while (buf && size >= 4) {
+			if (buf[0] < 4 || buf[0] > size)
+				break;
+			if (buf[1] == USB_DT_CS_INTERFACE)
+				query_clock(udev, buf, ac->bInterfaceProtocol,
+					    ac->bInterfaceNumber);
+			size -= buf[0];
+			buf += buf[0];
+		}
+		libusb_release_interface(udev, ac->bInterfaceNumber);
+	}
+	return clocks_unavailable;
+}
+
+static void dump_clock_value(const char *name, const struct clock_value *v,
+			     const char *unit, unsigned int indent)
+{
+	if (v->ret == LIBUSB_ERROR_NOT_SUPPORTED)
+		return;
+	if (v->ret < 0)
+		printf("%*s%-24s (%s)\n", indent * 2, "", name,
+		       libusb_error_name(v->ret));
+	else
+		printf("%*s%-24s %9u%s\n", indent * 2, "", name, v->value, unit);
+}
+
+void audio_clock_dump(unsigned int id, unsigned int indent)
+{
+	const struct clock_entity *c = &clocks[id & 0xff];
+	unsigned int i;
+
+	if (c->type == CLOCK_NONE) {
+		if (clocks_unavailable)
+			printf("%*sClock Requests:\n"
+			       "%*s** UNAVAILABLE **\n",
+			       indent * 2, "", indent * 2 + 2, "");
+		return;
+	}
+
+	switch (c->type) {
+	case CLOCK_SOURCE:
+		dump_clock_value("Sampling Frequency", &c->freq, " Hz", indent);
+		if (c->range_ret < 0 && c->range_ret != LIBUSB_ERROR_NOT_SUPPORTED)
+			printf("%*s%-24s (%s)\n", indent * 2, "",
+			       "Sampling Frequency Range",
+			       libusb_error_name(c->range_ret));
+		for (i = 0; i < c->nranges; i++) {
+			if (c->ranges[i][0] == c->ranges[i][1])
+				printf("%*sSampling Frequency Range %9u Hz\n",
+				       indent * 2, "", c->ranges[i][0]);
+			else
+				printf("%*sSampling Frequency Range %9u - %u Hz, step %u Hz\n",
+				       indent * 2, "", c->ranges[i][0],
+				       c->ranges[i][1], c->ranges[i][2]);
+		}
+		dump_clock_value("Clock Validity", &c->valid, "", indent);
+		break;
+	case CLOCK_SELECTOR:
+		dump_clock_value("Selected Input Pin", &c->pin, "", indent);
+		break;
+	case CLOCK_MULTIPLIER:
+		dump_clock_value("Clock Numerator", &c->numerator, "", indent);
+		dump_clock_value("Clock Denominator", &c->denominator, "", indent);
+		break;
+	default:
+		break;
+	}
+}
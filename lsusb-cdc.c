@@ -0,0 +1,424 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * CDC NCM/MBIM NTB parameter report for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+#include "bandwidth.h"
+
+#define USB_DT_CS_INTERFACE		0x24
+
+#define USB_CDC_SUBCLASS_NCM		0x0d
+#define USB_CDC_SUBCLASS_MBIM		0x0e
+
+/* functional descriptor subtypes */
+#define USB_CDC_UNION_TYPE		0x06
+#define USB_CDC_ETHERNET_TYPE		0x0f
+#define USB_CDC_NCM_TYPE		0x1a
+#define USB_CDC_MBIM_TYPE		0x1b
+#define USB_CDC_MBIM_EXTENDED_TYPE	0x1c
+
+/* NCM class requests */
+#define USB_CDC_GET_NTB_PARAMETERS	0x80
+#define USB_CDC_GET_NTB_INPUT_SIZE	0x85
+
+#define USB_CDC_NCM_NCAP_NTB_INPUT_SIZE	(1 << 5)
+
+#define NTB_PARAMETERS_SIZE		28
+
+/* the Linux cdc_ncm driver's limits, include/linux/usb/cdc_ncm.h as of 6.x */
+#define CDC_NCM_NTB_DEF_SIZE_TX		16384
+#define CDC_NCM_NTB_DEF_SIZE_RX		16384
+#define CDC_NCM_NTB_MAX_SIZE_TX		65536
+#define CDC_NCM_NTB_MAX_SIZE_RX		65536
+#define CDC_NCM_NTB_MIN_SIZE		2048
+#define CDC_NCM_DPT_DATAGRAMS_MAX	40
+
+/* the NTB parameter structure, GET_NTB_PARAMETERS or cdc_ncm's copy */
+struct ntb_params {
+	unsigned int formats;
+	unsigned int in_max;
+	unsigned int in_divisor;
+	unsigned int in_remainder;
+	unsigned int in_alignment;
+	unsigned int out_max;
+	unsigned int out_divisor;
+	unsigned int out_remainder;
+	unsigned int out_alignment;
+	unsigned int out_max_datagrams;
+};
+
+/* what the class-specific descriptors of the control interface say */
+struct ncm_func {
+	unsigned int data_ifnum;
+	unsigned int capabilities;
+	unsigned int max_segment;
+	unsigned int max_control;	/* MBIM only */
+	unsigned int mtu;		/* MBIM extended only */
+};
+
+/* ---------------------------------------------------------------------- */
+
+static void parse_ncm_func(const struct libusb_interface_descriptor *ctrl,
+			   struct ncm_func *f)
+{
+	const unsigned char *buf = ctrl->extra;
+	int size = ctrl->extra_length;
+
+	memset(f, 0, sizeof(*f));
+	f->data_ifnum = ctrl->bInterfaceNumber + 1;
+	while (buf && size >= 3) {
+		if (buf[0] < 3 || buf[0] > size)
+			break;
+		if (buf[1] != USB_DT_CS_INTERFACE)
+			goto next;
+
+		switch (buf[2]) {
+		case USB_CDC_UNION_TYPE:
+			if (buf[0] >= 5)
+				f->data_ifnum = buf[4];
+			break;
+		case USB_CDC_ETHERNET_TYPE:
+			if (buf[0] >= 13)
+				f->max_segment = convert_le_u16(buf + 8);
+			break;
+		case USB_CDC_NCM_TYPE:
+			if (buf[0] >= 6)
+				f->capabilities = buf[5];
+			break;
+		case USB_CDC_MBIM_TYPE:
+			if (buf[0] >= 12) {
+				f->max_control = convert_le_u16(buf + 5);
+				f->max_segment = convert_le_u16(buf + 9);
+				f->capabilities = buf[11];
+			}
+			break;
+		case USB_CDC_MBIM_EXTENDED_TYPE:
+			if (buf[0] >= 8)
+				f->mtu = convert_le_u16(buf + 6);
+			break;
+		}
+next:
+		size -= buf[0];
+		buf += buf[0];
+	}
+}
+
+static int ncm_request(libusb_device_handle *udev, uint8_t request,
+		       unsigned int ifnum, unsigned char *buf, unsigned int len)
+{
+	return libusb_control_transfer(udev,
+			LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
+				LIBUSB_RECIPIENT_INTERFACE,
+			request, 0, ifnum, buf, len, CTRL_TIMEOUT);
+}
+
+static void decode_ntb_params(const unsigned char *buf, struct ntb_params *p)
+{
+	p->formats = convert_le_u16(buf + 2);
+	p->in_max = convert_le_u32(buf + 4);
+	p->in_divisor = convert_le_u16(buf + 8);
+	p->in_remainder = convert_le_u16(buf + 10);
+	p->in_alignment = convert_le_u16(buf + 12);
+	p->out_max = convert_le_u32(buf + 16);
+	p->out_divisor = convert_le_u16(buf + 20);
+	p->out_remainder = convert_le_u16(buf + 22);
+	p->out_alignment = convert_le_u16(buf + 24);
+	p->out_max_datagrams = convert_le_u16(buf + 26);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ * The host side: the network interface cdc_ncm (or cdc_mbim, which shares
+ * its sysfs attributes) created on the control interface, if any.
+ */
+struct ncm_host {
+	char driver[64];
+	char netdev[64];
+	char dir[PATH_MAX];	/* <intf>/net/<netdev>/cdc_ncm below /sys/bus/usb/devices */
+};
+
+/* cdc_ncm prints some of its attributes in hex */
+static int read_attr(const char *dir, const char *attr, unsigned long *val)
+{
+	char buf[32];
+
+	if (read_sysfs_attr(buf, sizeof(buf), dir, attr))
+		return -1;
+	*val = strtoul(buf, NULL, 0);
+	return 0;
+}
+
+static int find_ncm_host(libusb_device *dev, unsigned int config,
+			 unsigned int ifnum, struct ncm_host *h)
+{
+	char name[64], path[PATH_MAX];
+	struct dirent *de;
+	DIR *d;
+
+	memset(h, 0, sizeof(*h));
+	if (get_sysfs_name(name, sizeof(name), dev) ||
+	    get_interface_driver_sysfs(h->driver, sizeof(h->driver), name, config, ifnum))
+		return -1;
+
+	snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s:%u.%u/net",
+		 name, config, ifnum);
+	d = opendir(path);
+	if (!d)
+		return -1;
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(h->netdev, sizeof(h->netdev), "%s", de->d_name);
+		break;
+	}
+	closedir(d);
+	if (!h->netdev[0])
+		return -1;
+	snprintf(h->dir, sizeof(h->dir), "%s:%u.%u/net/%s/cdc_ncm",
+		 name, config, ifnum, h->netdev);
+	return 0;
+}
+
+/* the device's NTB parameters as cdc_ncm read them at bind time */
+static int read_host_params(const struct ncm_host *h, struct ntb_params *p)
+{
+	static const char * const attrs[] = {
+		"bmNtbFormatsSupported", "dwNtbInMaxSize", "wNdpInDivisor",
+		"wNdpInPayloadRemainder", "wNdpInAlignment", "dwNtbOutMaxSize",
+		"wNdpOutDivisor", "wNdpOutPayloadRemainder", "wNdpOutAlignment",
+		"wNtbOutMaxDatagrams",
+	};
+	unsigned int *fields[] = {
+		&p->formats, &p->in_max, &p->in_divisor,
+		&p->in_remainder, &p->in_alignment, &p->out_max,
+		&p->out_divisor, &p->out_remainder, &p->out_alignment,
+		&p->out_max_datagrams,
+	};
+	unsigned long val;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+		if (read_attr(h->dir, attrs[i], &val))
+			return -1;
+		*fields[i] = val;
+	}
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static unsigned int min_u(unsigned int a, unsigned int b)
+{
+	return a < b ? a : b;
+}
+
+static void print_ntb_params(const struct ntb_params *p, const char *source)
+{
+	printf("    NTB Parameters (%s):\n"
+	       "      bmNtbFormatsSupported    0x%04x%s%s\n"
+	       "      dwNtbInMaxSize           %6u\n"
+	       "      wNdpInDivisor            %6u\n"
+	       "      wNdpInPayloadRemainder   %6u\n"
+	       "      wNdpInAlignment          %6u\n"
+	       "      dwNtbOutMaxSize          %6u\n"
+	       "      wNdpOutDivisor           %6u\n"
+	       "      wNdpOutPayloadRemainder  %6u\n"
+	       "      wNdpOutAlignment         %6u\n"
+	       "      wNtbOutMaxDatagrams      %6u%s\n",
+	       source,
+	       p->formats,
+	       p->formats & 1 ? " NTB-16" : "",
+	       p->formats & 2 ? " NTB-32" : "",
+	       p->in_max, p->in_divisor, p->in_remainder, p->in_alignment,
+	       p->out_max, p->out_divisor, p->out_remainder, p->out_alignment,
+	       p->out_max_datagrams,
+	       p->out_max_datagrams ? "" : " (no limit)");
+}
+
+static void print_size_row(const char *name, unsigned int dev_max,
+			   unsigned long host, int have_host,
+			   unsigned int host_limit, unsigned int bulk_maxp)
+{
+	printf("      %-22s %8u ", name, dev_max);
+	if (have_host)
+		printf("%8lu", host);
+	else
+		printf("%8s", "-");
+	printf(" %8u", host_limit);
+	if (have_host && host < dev_max && host < host_limit)
+		printf("  raise up to %u", min_u(dev_max, host_limit));
+	else if (have_host && host < dev_max)
+		printf("  capped by driver");
+	if (have_host && bulk_maxp && host)
+		printf("  (%lu packets)", (host + bulk_maxp - 1) / bulk_maxp);
+	printf("\n");
+}
+
+/*
+ * Compare the device's NTB limits with the sizes the host driver runs
+ * with.  The driver starts at CDC_NCM_NTB_DEF_SIZE_RX/TX and can be raised
+ * to CDC_NCM_NTB_MAX_SIZE_RX/TX through the rx_max/tx_max attributes; both
+ * are clamped to what the device reports.  cdc_ncm does not export its
+ * datagram limit, so that row only has the device's and the driver's cap.
+ */
+static void print_host_compare(const struct ntb_params *p,
+			       const struct ncm_host *h, int bound,
+			       unsigned int bulk_maxp)
+{
+	unsigned long rx = 0, tx = 0;
+	unsigned int dev_dgrams;
+	int have_host = bound && !read_attr(h->dir, "rx_max", &rx) &&
+			!read_attr(h->dir, "tx_max", &tx);
+
+	if (bound)
+		printf("    Host Driver: %s on %s\n", h->driver, h->netdev);
+	else
+		printf("    Host Driver: not bound, Linux cdc_ncm would use %u byte NTBs\n",
+		       min_u(min_u(CDC_NCM_NTB_DEF_SIZE_RX, p->in_max),
+			     min_u(CDC_NCM_NTB_DEF_SIZE_TX, p->out_max)));
+
+	printf("      %-22s %8s %8s %8s\n", "", "Device", "Current", "Limit");
+	print_size_row("NTB IN size (rx_max)", p->in_max, rx, have_host,
+		       min_u(p->in_max, CDC_NCM_NTB_MAX_SIZE_RX), bulk_maxp);
+	print_size_row("NTB OUT size (tx_max)", p->out_max, tx, have_host,
+		       min_u(p->out_max, CDC_NCM_NTB_MAX_SIZE_TX), bulk_maxp);
+
+	dev_dgrams = p->out_max_datagrams ? p->out_max_datagrams : CDC_NCM_DPT_DATAGRAMS_MAX;
+	printf("      %-22s %8u %8s %8u\n", "Datagrams per OUT NTB",
+	       p->out_max_datagrams, "", min_u(dev_dgrams, CDC_NCM_DPT_DATAGRAMS_MAX));
+
+	if (p->in_max < CDC_NCM_NTB_MIN_SIZE || p->out_max < CDC_NCM_NTB_MIN_SIZE)
+		printf("      NTB size below the %u byte minimum of the NCM spec\n",
+		       CDC_NCM_NTB_MIN_SIZE);
+}
+
+static unsigned int bulk_in_maxp(const struct libusb_config_descriptor *config,
+				 unsigned int ifnum)
+{
+	int i, j, k;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		for (j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+
+			if (alt->bInterfaceNumber != ifnum)
+				break;
+			for (k = 0; k < alt->bNumEndpoints; k++) {
+				const struct libusb_endpoint_descriptor *ep = &alt->endpoint[k];
+
+				if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) ==
+				    LIBUSB_TRANSFER_TYPE_BULK &&
+				    (ep->bEndpointAddress & LIBUSB_ENDPOINT_IN))
+					return ep->wMaxPacketSize & 0x7ff;
+			}
+		}
+	}
+	return 0;
+}
+
+static void do_ncm_interface(libusb_device *dev, libusb_device_handle *udev,
+			     const struct libusb_config_descriptor *config,
+			     const struct libusb_interface_descriptor *ctrl)
+{
+	unsigned char buf[NTB_PARAMETERS_SIZE];
+	unsigned int ifnum = ctrl->bInterfaceNumber;
+	int mbim = ctrl->bInterfaceSubClass == USB_CDC_SUBCLASS_MBIM;
+	struct ntb_params p;
+	struct ncm_host h;
+	struct ncm_func f;
+	int bound, ret, have_params = 0;
+
+	parse_ncm_func(ctrl, &f);
+	bound = !find_ncm_host(dev, config->bConfigurationValue, ifnum, &h);
+
+	printf("  CDC %s Interface %u (data interface %u, %s):\n",
+	       mbim ? "MBIM" : "NCM", ifnum, f.data_ifnum,
+	       bw_speed_name(libusb_get_device_speed(dev)));
+	printf("    bmNetworkCapabilities      0x%02x\n"
+	       "    wMaxSegmentSize          %6u\n",
+	       f.capabilities, f.max_segment);
+	if (mbim)
+		printf("    wMaxControlMessage       %6u\n", f.max_control);
+	if (f.mtu)
+		printf("    wMTU                     %6u\n", f.mtu);
+
+	/* recent Linuxes require claim() for RECIP_INTERFACE */
+	if (udev && !libusb_claim_interface(udev, ifnum)) {
+		ret = ncm_request(udev, USB_CDC_GET_NTB_PARAMETERS, ifnum,
+				  buf, sizeof(buf));
+		if (ret == NTB_PARAMETERS_SIZE) {
+			decode_ntb_params(buf, &p);
+			print_ntb_params(&p, "GET_NTB_PARAMETERS");
+			have_params = 1;
+		} else {
+			printf("    GET_NTB_PARAMETERS failed (%s)\n",
+			       ret < 0 ? libusb_error_name(ret) : "short reply");
+		}
+
+		ret = ncm_request(udev, USB_CDC_GET_NTB_INPUT_SIZE, ifnum, buf,
+				  f.capabilities & USB_CDC_NCM_NCAP_NTB_INPUT_SIZE ? 8 : 4);
+		if (ret >= 4)
+			printf("    NTB Input Size (GET_NTB_INPUT_SIZE) %u\n",
+			       convert_le_u32(buf));
+		libusb_release_interface(udev, ifnum);
+	} else if (bound && !read_host_params(&h, &p)) {
+		/* the driver owns the interface but kept the answer */
+		print_ntb_params(&p, "as read by the host driver");
+		have_params = 1;
+	} else {
+		printf("    NTB Parameters:\n"
+		       "      ** UNAVAILABLE **\n");
+	}
+
+	if (have_params)
+		print_host_compare(&p, &h, bound, bulk_in_maxp(config, f.data_ifnum));
+}
+
+int lsusb_ntb(libusb_device *dev)
+{
+	struct libusb_config_descriptor *config;
+	libusb_device_handle *udev = NULL;
+	int i, opened = 0;
+
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return 1;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+		const struct libusb_interface_descriptor *ctrl;
+
+		if (intf->num_altsetting < 1)
+			continue;
+		ctrl = &intf->altsetting[0];
+		if (ctrl->bInterfaceClass != LIBUSB_CLASS_COMM ||
+		    (ctrl->bInterfaceSubClass != USB_CDC_SUBCLASS_NCM &&
+		     ctrl->bInterfaceSubClass != USB_CDC_SUBCLASS_MBIM))
+			continue;
+		if (!opened) {
+			opened = 1;
+			if (libusb_open(dev, &udev))
+				udev = NULL;
+		}
+		do_ncm_interface(dev, udev, config, ctrl);
+	}
+
+	if (udev)
+		libusb_close(udev);
+	libusb_free_config_descriptor(config);
+	return 0;
+}
@@ -0,0 +1,501 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Host controller interrupt and NUMA placement report for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+#include "names.h"
+
+#define MAX_CPUS		1024
+#define MAX_CTRL_IRQS		64
+#define MAX_CONTROLLERS		32
+
+/* a CPU taking this many times its fair share of all interrupts is busy */
+#define BUSY_FACTOR		2
+
+static const char proc_interrupts[] = "/proc/interrupts";
+static const char sys_bus_usb_devices[] = "/sys/bus/usb/devices";
+
+/* one numbered line of /proc/interrupts */
+struct irq_line {
+	unsigned int irq;
+	unsigned long long *count;	/* per CPU column */
+	char desc[128];
+};
+
+struct interrupts {
+	unsigned int ncpus;		/* columns */
+	unsigned int cpu[MAX_CPUS];	/* CPU number of each column */
+	unsigned long long total[MAX_CPUS];	/* all interrupts per column */
+	unsigned long long sum;
+	struct irq_line *lines;
+	unsigned int nlines;
+};
+
+struct controller {
+	char path[PATH_MAX];		/* sysfs directory of the controller */
+	char name[64];			/* "0000:00:14.0" */
+	char driver[64];
+	int node;			/* NUMA node, -1 if none */
+	unsigned char local[MAX_CPUS];	/* CPUs of that node */
+	int has_local;
+	unsigned int irqs[MAX_CTRL_IRQS];
+	unsigned int nirqs;
+	int buses[8];
+	unsigned int nbuses;
+};
+
+/* ---------------------------------------------------------------------- */
+
+/* "0-3,8,10-11" */
+static int parse_cpulist(const char *s, unsigned char *cpus)
+{
+	unsigned long a, b;
+	char *end;
+
+	memset(cpus, 0, MAX_CPUS);
+	while (*s && *s != '\n') {
+		a = strtoul(s, &end, 10);
+		if (end == s)
+			return -1;
+		b = a;
+		if (*end == '-')
+			b = strtoul(end + 1, &end, 10);
+		for (; a <= b && a < MAX_CPUS; a++)
+			cpus[a] = 1;
+		s = *end == ',' ? end + 1 : end;
+	}
+	return 0;
+}
+
+static void print_cpulist(const unsigned char *cpus)
+{
+	int i, start = -1, first = 1;
+
+	for (i = 0; i <= MAX_CPUS; i++) {
+		if (i < MAX_CPUS && cpus[i]) {
+			if (start < 0)
+				start = i;
+			continue;
+		}
+		if (start < 0)
+			continue;
+		printf("%s%d", first ? "" : ",", start);
+		if (i - 1 > start)
+			printf("-%d", i - 1);
+		first = 0;
+		start = -1;
+	}
+	if (first)
+		printf("none");
+}
+
+static int read_file(const char *path, char *buf, size_t size)
+{
+	FILE *f = fopen(path, "r");
+	size_t len;
+
+	if (!f)
+		return -1;
+	len = fread(buf, 1, size - 1, f);
+	fclose(f);
+	buf[len] = 0;
+	while (len && buf[len - 1] == '\n')
+		buf[--len] = 0;
+	return len ? 0 : -1;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int read_interrupts(struct interrupts *in)
+{
+	char *line = NULL, *p, *end;
+	size_t size = 0;
+	unsigned long v;
+	unsigned int i;
+	FILE *f;
+
+	f = fopen(proc_interrupts, "r");
+	if (!f) {
+		perror(proc_interrupts);
+		return -1;
+	}
+	/* header: the CPUs that are online, by number */
+	if (getline(&line, &size, f) > 0) {
+		for (p = line; (p = strstr(p, "CPU")) && in->ncpus < MAX_CPUS; p += 3)
+			in->cpu[in->ncpus++] = strtoul(p + 3, NULL, 10);
+	}
+	while (getline(&line, &size, f) > 0) {
+		struct irq_line *l, *n;
+
+		p = line;
+		while (isspace((unsigned char)*p))
+			p++;
+		v = strtoul(p, &end, 10);
+		if (end == p || *end != ':')
+			continue;	/* NMI, LOC, ... are not device interrupts */
+		n = realloc(in->lines, (in->nlines + 1) * sizeof(*n));
+		if (!n)
+			break;
+		in->lines = n;
+		l = &in->lines[in->nlines];
+		l->irq = v;
+		l->count = calloc(in->ncpus ? in->ncpus : 1, sizeof(*l->count));
+		if (!l->count)
+			break;
+		in->nlines++;
+		p = end + 1;
+		for (i = 0; i < in->ncpus; i++) {
+			l->count[i] = strtoull(p, &end, 10);
+			if (end == p)
+				break;
+			in->total[i] += l->count[i];
+			in->sum += l->count[i];
+			p = end;
+		}
+		while (isspace((unsigned char)*p))
+			p++;
+		snprintf(l->desc, sizeof(l->desc), "%s", p);
+		end = strchr(l->desc, '\n');
+		if (end)
+			*end = 0;
+	}
+	free(line);
+	fclose(f);
+	return 0;
+}
+
+static void free_interrupts(struct interrupts *in)
+{
+	unsigned int i;
+
+	for (i = 0; i < in->nlines; i++)
+		free(in->lines[i].count);
+	free(in->lines);
+}
+
+static const struct irq_line *find_irq(const struct interrupts *in, unsigned int irq)
+{
+	unsigned int i;
+
+	for (i = 0; i < in->nlines; i++)
+		if (in->lines[i].irq == irq)
+			return &in->lines[i];
+	return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void add_irq(struct controller *c, unsigned int irq)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->nirqs; i++)
+		if (c->irqs[i] == irq)
+			return;
+	if (c->nirqs < MAX_CTRL_IRQS)
+		c->irqs[c->nirqs++] = irq;
+}
+
+/*
+ * The controller's interrupts: MSI/MSI-X vectors of a PCI device, its
+ * legacy irq, or for platform controllers the /proc/interrupts lines
+ * that name the bus.
+ */
+static void controller_irqs(struct controller *c, const struct interrupts *in,
+			    int busnum)
+{
+	char path[PATH_MAX + 16], buf[32], token[16];
+	struct dirent *de;
+	unsigned int i;
+	DIR *d;
+
+	snprintf(path, sizeof(path), "%s/msi_irqs", c->path);
+	d = opendir(path);
+	if (d) {
+		while ((de = readdir(d)))
+			if (isdigit((unsigned char)de->d_name[0]))
+				add_irq(c, strtoul(de->d_name, NULL, 10));
+		closedir(d);
+	}
+	if (!c->nirqs) {
+		snprintf(path, sizeof(path), "%s/irq", c->path);
+		if (!read_file(path, buf, sizeof(buf)) && atoi(buf) > 0)
+			add_irq(c, atoi(buf));
+	}
+	if (!c->nirqs) {
+		snprintf(token, sizeof(token), "usb%d", busnum);
+		for (i = 0; i < in->nlines; i++) {
+			const char *p = strstr(in->lines[i].desc, token);
+
+			if (p && !isdigit((unsigned char)p[strlen(token)]))
+				add_irq(c, in->lines[i].irq);
+		}
+	}
+}
+
+static struct controller *find_controller(struct controller *ctrls,
+					  unsigned int *nctrls, int busnum,
+					  const struct interrupts *in)
+{
+	char link[PATH_MAX + 16], path[PATH_MAX], buf[PATH_MAX], *p;
+	struct controller *c;
+	unsigned int i;
+	ssize_t len;
+
+	snprintf(link, sizeof(link), "%s/usb%d", sys_bus_usb_devices, busnum);
+	if (!realpath(link, path))
+		return NULL;
+	p = strrchr(path, '/');
+	if (!p)
+		return NULL;
+	*p = 0;			/* the root hub's parent is the controller */
+
+	for (i = 0; i < *nctrls; i++)
+		if (!strcmp(ctrls[i].path, path))
+			goto found;
+	if (*nctrls == MAX_CONTROLLERS)
+		return NULL;
+
+	c = &ctrls[(*nctrls)++];
+	memset(c, 0, sizeof(*c));
+	snprintf(c->path, sizeof(c->path), "%s", path);
+	p = strrchr(path, '/');
+	snprintf(c->name, sizeof(c->name), "%s", p ? p + 1 : path);
+
+	snprintf(link, sizeof(link), "%s/driver", c->path);
+	len = readlink(link, buf, sizeof(buf) - 1);
+	if (len > 0) {
+		buf[len] = 0;
+		p = strrchr(buf, '/');
+		snprintf(c->driver, sizeof(c->driver), "%s", p ? p + 1 : buf);
+	}
+
+	c->node = -1;
+	snprintf(link, sizeof(link), "%s/numa_node", c->path);
+	if (!read_file(link, buf, sizeof(buf)))
+		c->node = atoi(buf);
+	snprintf(link, sizeof(link), "%s/local_cpulist", c->path);
+	if (!read_file(link, buf, sizeof(buf)) && !parse_cpulist(buf, c->local))
+		c->has_local = 1;
+
+	controller_irqs(c, in, busnum);
+	i = c - ctrls;
+found:
+	c = &ctrls[i];
+	if (c->nbuses < sizeof(c->buses) / sizeof(c->buses[0]))
+		c->buses[c->nbuses++] = busnum;
+	return c;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* devices whose throughput suffers from a slow interrupt path */
+static const char *high_rate(libusb_device *dev)
+{
+	struct libusb_config_descriptor *config;
+	const char *why = NULL;
+	int speed = libusb_get_device_speed(dev);
+	int i, j, k;
+
+	if (speed >= LIBUSB_SPEED_SUPER)
+		return "SuperSpeed";
+	if (speed != LIBUSB_SPEED_HIGH)
+		return NULL;
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return NULL;
+	for (i = 0; i < config->bNumInterfaces && !why; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		for (j = 0; j < intf->num_altsetting && !why; j++)
+			for (k = 0; k < intf->altsetting[j].bNumEndpoints; k++)
+				if ((intf->altsetting[j].endpoint[k].bmAttributes &
+				     LIBUSB_TRANSFER_TYPE_MASK) ==
+				    LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+					why = "isochronous";
+	}
+	libusb_free_config_descriptor(config);
+	return why;
+}
+
+struct irq_verdict {
+	int remote;			/* handled off the controller's node */
+	int busy;			/* handled by a CPU that is busy with interrupts */
+	unsigned int busy_cpu;
+};
+
+static void print_irq(const struct controller *c, unsigned int irq,
+		      const struct interrupts *in, struct irq_verdict *v)
+{
+	const struct irq_line *l = find_irq(in, irq);
+	unsigned char affinity[MAX_CPUS], effective[MAX_CPUS];
+	char path[64], buf[4096];
+	unsigned long long fair;
+	int have_eff = 0;
+	unsigned int i;
+
+	printf("    IRQ %u", irq);
+	if (l)
+		printf(" (%s)", l->desc);
+	printf("\n      affinity ");
+	snprintf(path, sizeof(path), "/proc/irq/%u/smp_affinity_list", irq);
+	if (!read_file(path, buf, sizeof(buf)) && !parse_cpulist(buf, affinity))
+		print_cpulist(affinity);
+	else
+		printf("unknown");
+	snprintf(path, sizeof(path), "/proc/irq/%u/effective_affinity_list", irq);
+	if (!read_file(path, buf, sizeof(buf)) && !parse_cpulist(buf, effective)) {
+		printf(", effective ");
+		print_cpulist(effective);
+		have_eff = 1;
+	}
+	printf("\n");
+	if (!l)
+		return;
+
+	printf("      count ");
+	fair = in->ncpus ? in->sum / in->ncpus : 0;
+	for (i = 0; i < in->ncpus; i++) {
+		unsigned int cpu = in->cpu[i];
+
+		if (!l->count[i])
+			continue;
+		printf(" CPU%u:%llu", cpu, l->count[i]);
+		if (c->has_local && cpu < MAX_CPUS && !c->local[cpu])
+			v->remote = 1;
+		if (fair && in->total[i] > BUSY_FACTOR * fair) {
+			v->busy = 1;
+			v->busy_cpu = cpu;
+		}
+	}
+	printf("\n");
+
+	/* not fired yet: judge by where it will be delivered */
+	if (have_eff && c->has_local)
+		for (i = 0; i < MAX_CPUS; i++)
+			if (effective[i] && !c->local[i])
+				v->remote = 1;
+}
+
+static void print_controller(const struct controller *c, libusb_device **list,
+			     ssize_t num_devs, const struct interrupts *in)
+{
+	struct irq_verdict v;
+	char vendor[128], product[128];
+	struct libusb_device_descriptor desc;
+	unsigned int i, j;
+	ssize_t k;
+
+	printf("Controller %s", c->name);
+	if (c->driver[0])
+		printf(" (%s)", c->driver);
+	printf(", bus");
+	for (i = 0; i < c->nbuses; i++)
+		printf("%s %03d", i ? "," : "", c->buses[i]);
+	printf("\n    NUMA node %d", c->node);
+	if (c->has_local) {
+		printf(", local CPUs ");
+		print_cpulist(c->local);
+	}
+	printf("\n");
+
+	memset(&v, 0, sizeof(v));
+	if (!c->nirqs)
+		printf("    no interrupts found\n");
+	for (i = 0; i < c->nirqs; i++)
+		print_irq(c, c->irqs[i], in, &v);
+
+	for (k = 0; k < num_devs; k++) {
+		const char *why;
+		int bus = libusb_get_bus_number(list[k]);
+
+		for (j = 0; j < c->nbuses; j++)
+			if (c->buses[j] == bus)
+				break;
+		if (j == c->nbuses || !libusb_get_parent(list[k]))
+			continue;
+		why = high_rate(list[k]);
+		if (!why && !verblevel)
+			continue;
+		if (libusb_get_device_descriptor(list[k], &desc))
+			continue;
+		get_vendor_string(vendor, sizeof(vendor), desc.idVendor);
+		get_product_string(product, sizeof(product), desc.idVendor, desc.idProduct);
+		printf("    Bus %03d Device %03d: ID %04x:%04x %s %s\n", bus,
+		       libusb_get_device_address(list[k]), desc.idVendor,
+		       desc.idProduct, vendor, product);
+		if (!why)
+			continue;
+		if (v.remote)
+			printf("      ** %s device, controller interrupts handled "
+			       "outside NUMA node %d **\n", why, c->node);
+		if (v.busy)
+			printf("      ** %s device, controller interrupts handled "
+			       "by CPU %u, which takes more than %dx its share "
+			       "of all interrupts **\n", why, v.busy_cpu, BUSY_FACTOR);
+	}
+}
+
+/*
+ * Map every bus to its host controller, the controller's NUMA node and
+ * interrupts, where those interrupts are delivered and how often they
+ * fired per CPU.  High rate devices (SuperSpeed, or isochronous at high
+ * speed) on a controller whose interrupts are handled off its node, or by
+ * a CPU drowning in interrupts, are flagged.  With -v every device is
+ * listed.
+ */
+int lsusb_irq(libusb_context *ctx, int busnum)
+{
+	struct interrupts *in;
+	struct controller *ctrls;
+	unsigned int nctrls = 0, i;
+	libusb_device **list;
+	ssize_t num_devs, k;
+
+	num_devs = libusb_get_device_list(ctx, &list);
+	if (num_devs < 0)
+		return 1;
+	in = calloc(1, sizeof(*in));
+	ctrls = calloc(MAX_CONTROLLERS, sizeof(*ctrls));
+	if (!in || !ctrls || read_interrupts(in)) {
+		free(ctrls);
+		free(in);
+		libusb_free_device_list(list, 1);
+		return 1;
+	}
+
+	for (k = 0; k < num_devs; k++) {
+		int bus = libusb_get_bus_number(list[k]);
+
+		if (libusb_get_parent(list[k]))
+			continue;
+		if (busnum != -1 && busnum != bus)
+			continue;
+		find_controller(ctrls, &nctrls, bus, in);
+	}
+
+	for (i = 0; i < nctrls; i++) {
+		if (i)
+			printf("\n");
+		print_controller(&ctrls[i], list, num_devs, in);
+	}
+
+	free_interrupts(in);
+	free(in);
+	free(ctrls);
+	libusb_free_device_list(list, 1);
+	return !nctrls;
+}
@@ -0,0 +1,831 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Hotplug monitor for lsusb: flapping ports and enumeration storms
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libudev.h>
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#define MONITOR_PORTS		128	/* least recently active evicted beyond this */
+#define MONITOR_BUSES		32
+#define PORT_HISTORY		32	/* reconnects remembered per port */
+#define BUS_HISTORY		64	/* enumerations remembered per bus */
+
+/* a port reconnecting this often is flapping */
+#define FLAP_COUNT		3
+#define FLAP_WINDOW_MS		60000
+/* this many enumerations on one bus stall its other devices */
+#define STORM_COUNT		16
+#define STORM_WINDOW_MS		10000
+
+static const unsigned int windows_ms[] = { 10000, 60000, 600000 };
+#define NWINDOWS (sizeof(windows_ms) / sizeof(windows_ms[0]))
+
+/* timestamps in a ring; only the last 'size' are kept */
+struct history {
+	uint64_t *ts;
+	unsigned int size;
+	unsigned int head;
+	unsigned int count;
+};
+
+struct port_stats {
+	char name[32];			/* sysfs name, the physical port path */
+	int used;
+	uint64_t last;			/* last event, for eviction */
+	unsigned int adds;
+	unsigned int removes;
+	int flapping;
+	unsigned int peak;		/* most reconnects in one FLAP_WINDOW_MS */
+	uint16_t vendor;
+	uint16_t product;
+	uint64_t ts[PORT_HISTORY];
+	struct history reconnects;
+};
+
+struct bus_stats {
+	unsigned int busnum;
+	int used;
+	uint64_t last;
+	unsigned int enumerations;
+	unsigned int storms;
+	int storming;
+	unsigned int peak;		/* most enumerations in one STORM_WINDOW_MS */
+	uint64_t ts[BUS_HISTORY];
+	struct history history;
+};
+
+struct monitor {
+	struct port_stats ports[MONITOR_PORTS];
+	struct bus_stats buses[MONITOR_BUSES];
+	unsigned int evicted;
+	uint64_t start;
+};
+
+static volatile sig_atomic_t stop;
+
+/* ---------------------------------------------------------------------- */
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t now_msec(void)
+{
+	return now_usec() / 1000;
+}
+
+static void history_add(struct history *h, uint64_t ts)
+{
+	h->ts[h->head] = ts;
+	h->head = (h->head + 1) % h->size;
+	if (h->count < h->size)
+		h->count++;
+}
+
+/* events in the last 'window' ms; saturates at the history size */
+static unsigned int history_count(const struct history *h, uint64_t now, unsigned int window)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < h->count; i++)
+		if (now - h->ts[(h->head + h->size - 1 - i) % h->size] <= window)
+			n++;
+		else
+			break;
+	return n;
+}
+
+static void sig_stop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static struct port_stats *find_port(struct monitor *m, const char *name, uint64_t now)
+{
+	struct port_stats *p, *oldest = NULL;
+	unsigned int i;
+
+	for (i = 0; i < MONITOR_PORTS; i++) {
+		p = &m->ports[i];
+		if (p->used && !strcmp(p->name, name))
+			return p;
+		if (!oldest || !p->used || (oldest->used && p->last < oldest->last))
+			oldest = p;
+	}
+	if (oldest->used)
+		m->evicted++;
+	memset(oldest, 0, sizeof(*oldest));
+	oldest->used = 1;
+	oldest->last = now;
+	snprintf(oldest->name, sizeof(oldest->name), "%s", name);
+	oldest->reconnects.ts = oldest->ts;
+	oldest->reconnects.size = PORT_HISTORY;
+	return oldest;
+}
+
+static struct bus_stats *find_bus(struct monitor *m, unsigned int busnum, uint64_t now)
+{
+	struct bus_stats *b, *oldest = NULL;
+	unsigned int i;
+
+	for (i = 0; i < MONITOR_BUSES; i++) {
+		b = &m->buses[i];
+		if (b->used && b->busnum == busnum)
+			return b;
+		if (!oldest || !b->used || (oldest->used && b->last < oldest->last))
+			oldest = b;
+	}
+	memset(oldest, 0, sizeof(*oldest));
+	oldest->used = 1;
+	oldest->busnum = busnum;
+	oldest->last = now;
+	oldest->history.ts = oldest->ts;
+	oldest->history.size = BUS_HISTORY;
+	return oldest;
+}
+
+static void print_time(uint64_t now, const struct monitor *m)
+{
+	uint64_t t = now - m->start;
+
+	printf("[%5llu.%03u] ", (unsigned long long)(t / 1000), (unsigned int)(t % 1000));
+}
+
+static void check_flapping(struct monitor *m, struct port_stats *p, uint64_t now)
+{
+	char context[512];
+	unsigned int n = history_count(&p->reconnects, now, FLAP_WINDOW_MS);
+
+	if (n > p->peak)
+		p->peak = n;
+	if (n < FLAP_COUNT) {
+		p->flapping = 0;
+		return;
+	}
+	if (p->flapping)
+		return;
+	p->flapping = 1;
+	if (lsusb_t_context(context, sizeof(context), p->name))
+		snprintf(context, sizeof(context), "%s", p->name);
+	print_time(now, m);
+	printf("** port %s is flapping: %u reconnects in %u s **\n",
+	       p->name, n, FLAP_WINDOW_MS / 1000);
+	printf("%14s%s\n", "", context);
+}
+
+static void check_storm(struct monitor *m, struct bus_stats *b, uint64_t now)
+{
+	unsigned int n = history_count(&b->history, now, STORM_WINDOW_MS);
+
+	if (n > b->peak)
+		b->peak = n;
+	if (n < STORM_COUNT) {
+		b->storming = 0;
+		return;
+	}
+	if (b->storming)
+		return;
+	b->storming = 1;
+	b->storms++;
+	print_time(now, m);
+	printf("** enumeration storm on bus %u: %u devices enumerated in %u s **\n",
+	       b->busnum, n, STORM_WINDOW_MS / 1000);
+}
+
+static void handle_event(struct monitor *m, struct udev_device *dev)
+{
+	const char *action = udev_device_get_action(dev);
+	const char *name = udev_device_get_sysname(dev);
+	const char *product = udev_device_get_property_value(dev, "PRODUCT");
+	unsigned int vendor_id, product_id, busnum;
+	uint64_t now = now_msec();
+	struct port_stats *p;
+	struct bus_stats *b;
+	int add;
+
+	if (!action || !name)
+		return;
+	add = !strcmp(action, "add");
+	if (!add && strcmp(action, "remove"))
+		return;
+	/* root hubs have no port */
+	if (sscanf(name, "%u-", &busnum) != 1)
+		return;
+
+	p = find_port(m, name, now);
+	p->last = now;
+	/* PRODUCT is in the remove event too, unlike the sysfs attributes */
+	if (product && sscanf(product, "%x/%x", &vendor_id, &product_id) == 2) {
+		p->vendor = vendor_id;
+		p->product = product_id;
+	}
+	print_time(now, m);
+	printf("%-6s %-16s %04x:%04x\n", action, name, p->vendor, p->product);
+
+	if (!add) {
+		p->removes++;
+		fflush(stdout);
+		return;
+	}
+	/* a connect after a disconnect we saw is a reconnect */
+	if (p->removes)
+		history_add(&p->reconnects, now);
+	p->adds++;
+	check_flapping(m, p, now);
+
+	b = find_bus(m, busnum, now);
+	b->last = now;
+	b->enumerations++;
+	history_add(&b->history, now);
+	check_storm(m, b, now);
+	fflush(stdout);
+}
+
+static int cmp_ports(const void *a, const void *b)
+{
+	const struct port_stats *pa = *(const struct port_stats * const *)a;
+	const struct port_stats *pb = *(const struct port_stats * const *)b;
+
+	if (pa->removes != pb->removes)
+		return pa->removes < pb->removes ? 1 : -1;
+	return strcmp(pa->name, pb->name);
+}
+
+static void print_summary(struct monitor *m)
+{
+	struct port_stats *sorted[MONITOR_PORTS];
+	uint64_t now = now_msec();
+	unsigned int i, w, n = 0;
+
+	for (i = 0; i < MONITOR_PORTS; i++)
+		if (m->ports[i].used)
+			sorted[n++] = &m->ports[i];
+	qsort(sorted, n, sizeof(sorted[0]), cmp_ports);
+
+	printf("\nHotplug summary after %llu s\n", (unsigned long long)((now - m->start) / 1000));
+	printf("%-16s %-9s %8s %8s %5s %5s %5s %9s\n", "Port", "ID", "Connects",
+	       "Removes", "10s", "1min", "10min", "Peak/min");
+	for (i = 0; i < n; i++) {
+		struct port_stats *p = sorted[i];
+
+		printf("%-16s %04x:%04x %8u %8u", p->name, p->vendor, p->product, p->adds, p->removes);
+		for (w = 0; w < NWINDOWS; w++) {
+			unsigned int c = history_count(&p->reconnects, now, windows_ms[w]);
+
+			printf(" %4u%s", c, c == PORT_HISTORY ? "+" : " ");
+		}
+		printf(" %8u%s\n", p->peak, p->peak >= FLAP_COUNT ? " flapping" : "");
+	}
+	if (m->evicted)
+		printf("(%u idle ports dropped to stay within %u)\n", m->evicted, MONITOR_PORTS);
+
+	for (i = 0; i < MONITOR_BUSES; i++) {
+		struct bus_stats *b = &m->buses[i];
+
+		if (!b->used)
+			continue;
+		printf("Bus %03u: %u enumerations, peak %u in %u s, %u storms\n", b->busnum,
+		       b->enumerations, b->peak, STORM_WINDOW_MS / 1000, b->storms);
+	}
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* usb_device events only, or everything for the device nodes as well */
+static struct udev_monitor *monitor_open(int usb_only)
+{
+	struct udev *udev = names_udev();
+	struct udev_monitor *mon;
+
+	if (!udev) {
+		fprintf(stderr, "udev is not available\n");
+		return NULL;
+	}
+	mon = udev_monitor_new_from_netlink(udev, "udev");
+	if (!mon) {
+		fprintf(stderr, "unable to open the udev monitor\n");
+		return NULL;
+	}
+	if ((usb_only && udev_monitor_filter_add_match_subsystem_devtype(mon, "usb", "usb_device")) ||
+	    udev_monitor_enable_receiving(mon)) {
+		fprintf(stderr, "unable to receive udev events\n");
+		udev_monitor_unref(mon);
+		return NULL;
+	}
+	return mon;
+}
+
+/*
+ * Hand each event to 'event', and call 'idle' when 'tick' ms pass without
+ * one (never if 'tick' is negative).  Stops when either returns non-zero,
+ * which is then returned, or on SIGINT/SIGTERM (0).  -1 on errors.
+ */
+static int monitor_loop(struct udev_monitor *mon, int tick,
+			int (*event)(struct udev_device *dev, void *data),
+			int (*idle)(void *data), void *data)
+{
+	struct sigaction sa;
+	struct udev_device *dev;
+	struct pollfd pfd;
+	int ret = 0, n;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	pfd.fd = udev_monitor_get_fd(mon);
+	pfd.events = POLLIN;
+	while (!stop && !ret) {
+		n = poll(&pfd, 1, tick);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			return -1;
+		}
+		if (n == 0) {
+			if (idle)
+				ret = idle(data);
+			continue;
+		}
+		dev = udev_monitor_receive_device(mon);
+		if (!dev)
+			continue;
+		ret = event(dev, data);
+		udev_device_unref(dev);
+	}
+	return ret;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int monitor_event(struct udev_device *dev, void *data)
+{
+	handle_event(data, dev);
+	return 0;
+}
+
+/*
+ * Watch USB connects and disconnects until interrupted.  Ports that keep
+ * reconnecting are reported with their place in the tree, and buses that
+ * enumerate many devices at once are reported as storms.  Memory use is
+ * fixed however long it runs.
+ */
+int lsusb_monitor(void)
+{
+	struct udev_monitor *mon;
+	struct monitor *m;
+	int ret;
+
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return 1;
+	mon = monitor_open(1);
+	if (!mon) {
+		free(m);
+		return 1;
+	}
+
+	m->start = now_msec();
+	printf("Monitoring USB hotplug, interrupt to stop\n");
+	fflush(stdout);
+	ret = monitor_loop(mon, -1, monitor_event, NULL, m);
+	print_summary(m);
+	udev_monitor_unref(mon);
+	free(m);
+	return ret < 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+#define PROFILE_PLUGS		32	/* devices enumerating at the same time */
+#define PROFILE_KEYS		128	/* (vid, pid, driver, stage) histograms */
+#define PROFILE_BUCKETS		28	/* [2^i, 2^(i+1)) us, up to 134 s */
+/* a device is ready when nothing new happened for this long */
+#define PROFILE_SETTLE_MS	2000
+
+struct plug {
+	int used;
+	char devpath[256];
+	char name[32];
+	uint16_t vendor;
+	uint16_t product;
+	uint64_t add;			/* usec */
+	uint64_t last;
+	unsigned int events;
+};
+
+struct latency {
+	int used;
+	uint16_t vendor;
+	uint16_t product;
+	char driver[32];
+	char stage[16];			/* "bind", a node's subsystem, or "ready" */
+	unsigned int count;
+	uint64_t min;
+	uint64_t max;
+	unsigned int buckets[PROFILE_BUCKETS];
+};
+
+struct profile {
+	struct plug plugs[PROFILE_PLUGS];
+	struct latency latencies[PROFILE_KEYS];
+	unsigned int dropped;
+	unsigned int cycles;
+};
+
+static void latency_add(struct profile *pr, const struct plug *p, const char *driver,
+			const char *stage, uint64_t usec)
+{
+	struct latency *l = NULL;
+	unsigned int i, b;
+
+	for (i = 0; i < PROFILE_KEYS; i++) {
+		struct latency *k = &pr->latencies[i];
+
+		if (!k->used) {
+			if (!l)
+				l = k;
+			continue;
+		}
+		if (k->vendor == p->vendor && k->product == p->product &&
+		    !strcmp(k->driver, driver) && !strcmp(k->stage, stage)) {
+			l = k;
+			break;
+		}
+	}
+	if (!l) {
+		pr->dropped++;
+		return;
+	}
+	if (!l->used) {
+		l->used = 1;
+		l->vendor = p->vendor;
+		l->product = p->product;
+		snprintf(l->driver, sizeof(l->driver), "%s", driver);
+		snprintf(l->stage, sizeof(l->stage), "%s", stage);
+		l->min = usec;
+	}
+	for (b = 0; b < PROFILE_BUCKETS - 1 && usec >= (2ULL << b); b++)
+		;
+	l->buckets[b]++;
+	l->count++;
+	if (usec < l->min)
+		l->min = usec;
+	if (usec > l->max)
+		l->max = usec;
+}
+
+/* upper edge of the bucket holding the given fraction, capped by max */
+static uint64_t latency_quantile(const struct latency *l, double q)
+{
+	unsigned int b, n = 0, want = l->count * q;
+
+	for (b = 0; b < PROFILE_BUCKETS; b++) {
+		n += l->buckets[b];
+		if (n > want)
+			break;
+	}
+	if (b == PROFILE_BUCKETS || (2ULL << b) > l->max)
+		return l->max;
+	return 2ULL << b;
+}
+
+static struct plug *find_plug(struct profile *pr, const char *devpath)
+{
+	unsigned int i;
+
+	for (i = 0; i < PROFILE_PLUGS; i++)
+		if (pr->plugs[i].used && !strcmp(pr->plugs[i].devpath, devpath))
+			return &pr->plugs[i];
+	return NULL;
+}
+
+/* the plug a device below a usb_device belongs to */
+static struct plug *find_plug_of(struct profile *pr, struct udev_device *dev)
+{
+	struct udev_device *usb;
+
+	usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+	if (!usb || !udev_device_get_devpath(usb))
+		return NULL;
+	return find_plug(pr, udev_device_get_devpath(usb));
+}
+
+static void print_msec(uint64_t usec)
+{
+	printf(" %8.1f", usec / 1000.0);
+}
+
+static void plug_done(struct profile *pr, struct plug *p)
+{
+	if (p->events) {
+		latency_add(pr, p, "", "ready", p->last - p->add);
+		pr->cycles++;
+		printf("%-16s %04x:%04x ready after %.1f ms, %u binds and nodes\n",
+		       p->name, p->vendor, p->product, (p->last - p->add) / 1000.0, p->events);
+		fflush(stdout);
+	}
+	p->used = 0;
+}
+
+static void plug_add(struct profile *pr, struct udev_device *dev, uint64_t now)
+{
+	const char *devpath = udev_device_get_devpath(dev);
+	const char *product = udev_device_get_property_value(dev, "PRODUCT");
+	unsigned int vendor_id, product_id, i;
+	struct plug *p = NULL;
+
+	if (!devpath || find_plug(pr, devpath))
+		return;
+	/* a free slot, or the longest enumerating device */
+	for (i = 0; i < PROFILE_PLUGS && (!p || p->used); i++)
+		if (!p || !pr->plugs[i].used || pr->plugs[i].add < p->add)
+			p = &pr->plugs[i];
+	if (p->used)
+		plug_done(pr, p);
+	memset(p, 0, sizeof(*p));
+	p->used = 1;
+	p->add = p->last = now;
+	snprintf(p->devpath, sizeof(p->devpath), "%s", devpath);
+	snprintf(p->name, sizeof(p->name), "%s", udev_device_get_sysname(dev));
+	if (product && sscanf(product, "%x/%x", &vendor_id, &product_id) == 2) {
+		p->vendor = vendor_id;
+		p->product = product_id;
+	}
+}
+
+static int profile_idle(void *data)
+{
+	struct profile *pr = data;
+	uint64_t now = now_usec();
+	unsigned int i;
+
+	for (i = 0; i < PROFILE_PLUGS; i++)
+		if (pr->plugs[i].used &&
+		    now - pr->plugs[i].last >= PROFILE_SETTLE_MS * 1000ULL)
+			plug_done(pr, &pr->plugs[i]);
+	return 0;
+}
+
+static int profile_event(struct udev_device *dev, void *data)
+{
+	struct profile *pr = data;
+	const char *action = udev_device_get_action(dev);
+	const char *subsystem = udev_device_get_subsystem(dev);
+	const char *devtype = udev_device_get_devtype(dev);
+	const char *driver, *stage;
+	struct udev_device *intf;
+	uint64_t now = now_usec();
+	struct plug *p;
+
+	/* a busy system may never let the monitor go idle */
+	profile_idle(pr);
+	if (!action || !subsystem)
+		return 0;
+	if (!strcmp(subsystem, "usb") && devtype && !strcmp(devtype, "usb_device")) {
+		if (!strcmp(action, "add"))
+			plug_add(pr, dev, now);
+		else if (!strcmp(action, "remove") &&
+			 (p = find_plug(pr, udev_device_get_devpath(dev))))
+			plug_done(pr, p);
+		return 0;
+	}
+
+	if (!strcmp(subsystem, "usb") && devtype && !strcmp(devtype, "usb_interface")) {
+		/* a driver finished probing the interface */
+		if (strcmp(action, "bind"))
+			return 0;
+		intf = dev;
+		stage = "bind";
+	} else {
+		/* a device node of a class device below the usb_device */
+		if (strcmp(action, "add") || !udev_device_get_devnode(dev))
+			return 0;
+		intf = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_interface");
+		stage = subsystem;
+	}
+	p = find_plug_of(pr, dev);
+	if (!p)
+		return 0;
+	driver = intf ? udev_device_get_driver(intf) : NULL;
+	latency_add(pr, p, driver ? driver : "", stage, now - p->add);
+	p->last = now;
+	p->events++;
+	if (verblevel) {
+		printf("%-16s %04x:%04x %-6s %-12s %s after %.1f ms\n", p->name, p->vendor,
+		       p->product, stage, driver ? driver : "-",
+		       udev_device_get_devnode(dev) ? udev_device_get_devnode(dev) :
+		       udev_device_get_sysname(dev), (now - p->add) / 1000.0);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+static int cmp_latencies(const void *a, const void *b)
+{
+	const struct latency *la = a, *lb = b;
+	int ready_a, ready_b;
+
+	if (la->used != lb->used)
+		return lb->used - la->used;
+	if (la->vendor != lb->vendor)
+		return la->vendor - lb->vendor;
+	if (la->product != lb->product)
+		return la->product - lb->product;
+	/* the total goes last */
+	ready_a = !strcmp(la->stage, "ready");
+	ready_b = !strcmp(lb->stage, "ready");
+	if (ready_a != ready_b)
+		return ready_a - ready_b;
+	if (la->max != lb->max)
+		return la->max < lb->max ? -1 : 1;
+	return strcmp(la->driver, lb->driver);
+}
+
+static void print_profile(struct profile *pr)
+{
+	unsigned int i, b;
+
+	for (i = 0; i < PROFILE_PLUGS; i++)
+		if (pr->plugs[i].used)
+			plug_done(pr, &pr->plugs[i]);
+	qsort(pr->latencies, PROFILE_KEYS, sizeof(pr->latencies[0]), cmp_latencies);
+
+	printf("\nPlug to ready latency over %u plug cycles (ms)\n", pr->cycles);
+	printf("%-9s %-12s %-8s %6s %8s %8s %8s %8s\n", "ID", "Driver", "Stage",
+	       "Count", "Min", "Median", "90%", "Max");
+	for (i = 0; i < PROFILE_KEYS && pr->latencies[i].used; i++) {
+		const struct latency *l = &pr->latencies[i];
+
+		printf("%04x:%04x %-12s %-8s %6u", l->vendor, l->product,
+		       l->driver[0] ? l->driver : "-", l->stage, l->count);
+		print_msec(l->min);
+		print_msec(latency_quantile(l, 0.5));
+		print_msec(latency_quantile(l, 0.9));
+		print_msec(l->max);
+		printf("\n");
+		if (verblevel < 1)
+			continue;
+		for (b = 0; b < PROFILE_BUCKETS; b++)
+			if (l->buckets[b])
+				printf("%32s< %8.1f ms %6u\n", "", (2ULL << b) / 1000.0, l->buckets[b]);
+	}
+	if (pr->dropped)
+		printf("(%u samples dropped, more than %u histograms)\n", pr->dropped, PROFILE_KEYS);
+}
+
+/*
+ * Time each USB device from its udev "add" to every interface's driver
+ * binding and to the device nodes appearing below it, and collect the
+ * latencies per vendor, product and driver across plug cycles.
+ */
+int lsusb_hotplug_profile(void)
+{
+	struct udev_monitor *mon;
+	struct profile *pr;
+	int ret;
+
+	pr = calloc(1, sizeof(*pr));
+	if (!pr)
+		return 1;
+	mon = monitor_open(0);
+	if (!mon) {
+		free(pr);
+		return 1;
+	}
+
+	printf("Profiling USB hotplug, plug devices in and interrupt to stop\n");
+	fflush(stdout);
+	ret = monitor_loop(mon, PROFILE_SETTLE_MS / 2, profile_event, profile_idle, pr);
+	print_profile(pr);
+	udev_monitor_unref(mon);
+	free(pr);
+	return ret < 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+struct waiter {
+	const struct usb_match *match;
+	uint64_t deadline;		/* msec, 0 for none */
+};
+
+static int sysattr_int(struct udev_device *dev, const char *attr, int base)
+{
+	const char *val = udev_device_get_sysattr_value(dev, attr);
+
+	return val ? (int)strtoul(val, NULL, base) : -1;
+}
+
+/* usb_match_device() for a device known to udev only */
+static int udev_match_device(struct udev_device *dev, const struct usb_match *m)
+{
+	const char *serial;
+
+	if ((m->busnum != -1 && m->busnum != sysattr_int(dev, "busnum", 10)) ||
+	    (m->devnum != -1 && m->devnum != sysattr_int(dev, "devnum", 10)) ||
+	    (m->vendor != -1 && m->vendor != sysattr_int(dev, "idVendor", 16)) ||
+	    (m->product != -1 && m->product != sysattr_int(dev, "idProduct", 16)))
+		return 0;
+	if (!m->serial)
+		return 1;
+	serial = udev_device_get_sysattr_value(dev, "serial");
+	return serial && !strcmp(serial, m->serial);
+}
+
+static int wait_idle(void *data)
+{
+	struct waiter *w = data;
+
+	return w->deadline && now_msec() >= w->deadline ? 2 : 0;
+}
+
+static int wait_event(struct udev_device *dev, void *data)
+{
+	struct waiter *w = data;
+	const char *action = udev_device_get_action(dev);
+
+	if (action && !strcmp(action, "add") && udev_match_device(dev, w->match)) {
+		if (udev_device_get_devnode(dev))
+			printf("%s\n", udev_device_get_devnode(dev));
+		else
+			printf("/dev/bus/usb/%03d/%03d\n", sysattr_int(dev, "busnum", 10),
+			       sysattr_int(dev, "devnum", 10));
+		return 1;
+	}
+	return wait_idle(data);
+}
+
+/* the device node of the first matching device present, as -d would list it */
+static int wait_present(libusb_context *ctx, const struct usb_match *m)
+{
+	struct libusb_device_descriptor desc;
+	libusb_device **list;
+	ssize_t n, i;
+	int found = 0;
+
+	n = libusb_get_device_list(ctx, &list);
+	if (n < 0)
+		return 0;
+	for (i = 0; i < n && !found; i++) {
+		if (libusb_get_device_descriptor(list[i], &desc) ||
+		    !usb_match_device(list[i], &desc, m))
+			continue;
+		printf("/dev/bus/usb/%03u/%03u\n", libusb_get_bus_number(list[i]),
+		       libusb_get_device_address(list[i]));
+		found = 1;
+	}
+	libusb_free_device_list(list, 1);
+	return found;
+}
+
+/*
+ * Wait until a matching device is present, for at most 'timeout' ms if not
+ * negative, and print its device node.  udev is listened to before the
+ * devices present are checked, so one appearing in between is not missed.
+ * Returns 0 once found, like a matching -d.
+ */
+int lsusb_wait(libusb_context *ctx, const struct usb_match *match, int timeout)
+{
+	struct udev_monitor *mon;
+	struct waiter w;
+	int ret;
+
+	mon = monitor_open(1);
+	if (!mon)
+		return 1;
+	if (wait_present(ctx, match)) {
+		udev_monitor_unref(mon);
+		return 0;
+	}
+	w.match = match;
+	w.deadline = timeout >= 0 ? now_msec() + timeout : 0;
+	ret = timeout == 0 ? 2 :
+		monitor_loop(mon, timeout > 0 ? 100 : -1, wait_event, wait_idle, &w);
+	udev_monitor_unref(mon);
+	return ret != 1;
+}
@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Autosuspend and link power management audit for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+
+#define USB_CLASS_VIDEO			0x0e
+#define USB_CLASS_AUDIO_VIDEO		0x10
+
+/* USB 2.0 extension bmAttributes */
+#define USB2_EXT_LPM			0x02
+#define USB2_EXT_BESL			0x04
+#define USB2_EXT_BASELINE_BESL_VALID	0x08
+#define USB2_EXT_DEEP_BESL_VALID	0x10
+
+/* autosuspend this soon is a wake up on nearly every idle moment */
+#define AGGRESSIVE_AUTOSUSPEND_MS	2000
+/* U2 exit latency that a periodic stream notices */
+#define SLOW_U2_EXIT_US			500
+
+/* USB 2.0 LPM ECN, table X-X1: BESL value to microseconds */
+static const unsigned int besl_us[16] = {
+	125, 150, 200, 300, 400, 500, 1000, 2000,
+	3000, 4000, 5000, 6000, 7000, 8000, 9000, 10000
+};
+
+struct power_state {
+	char name[64];			/* sysfs name, the topology path */
+	char control[16];		/* "auto" or "on" */
+	char status[16];		/* runtime_status */
+	int delay_ms;			/* autosuspend_delay_ms, -1 if unknown */
+	char usb2_lpm[16];		/* power/usb2_hardware_lpm */
+	char u1[16];			/* power/usb3_hardware_lpm_u1 */
+	char u2[16];			/* power/usb3_hardware_lpm_u2 */
+	char permit[16];		/* port/usb3_lpm_permit */
+
+	/* from the BOS, -1 if not read */
+	int bos;
+	uint32_t usb2_attributes;	/* 0 without a USB 2.0 extension */
+	int u1_exit_us;			/* -1 without a SuperSpeed capability */
+	int u2_exit_us;
+
+	const char *sensitive;		/* why wake latency matters, or NULL */
+	int bound;			/* interfaces with a driver */
+};
+
+/* ---------------------------------------------------------------------- */
+
+static void read_attr(char *buf, size_t size, const char *name, const char *attr)
+{
+	if (read_sysfs_attr(buf, size, name, attr))
+		buf[0] = 0;
+}
+
+static void read_power_attrs(struct power_state *p)
+{
+	char buf[32];
+
+	read_attr(p->control, sizeof(p->control), p->name, "power/control");
+	read_attr(p->status, sizeof(p->status), p->name, "power/runtime_status");
+	read_attr(buf, sizeof(buf), p->name, "power/autosuspend_delay_ms");
+	p->delay_ms = buf[0] ? atoi(buf) : -1;
+	read_attr(p->usb2_lpm, sizeof(p->usb2_lpm), p->name, "power/usb2_hardware_lpm");
+	read_attr(p->u1, sizeof(p->u1), p->name, "power/usb3_hardware_lpm_u1");
+	read_attr(p->u2, sizeof(p->u2), p->name, "power/usb3_hardware_lpm_u2");
+	read_attr(p->permit, sizeof(p->permit), p->name, "port/usb3_lpm_permit");
+}
+
+static void read_bos(libusb_device *dev, struct power_state *p)
+{
+	struct libusb_device_handle *udev;
+	struct libusb_bos_descriptor *bos;
+	struct libusb_usb_2_0_extension_descriptor *usb2;
+	struct libusb_ss_usb_device_capability_descriptor *ss;
+	int i;
+
+	p->bos = -1;
+	p->u1_exit_us = p->u2_exit_us = -1;
+	if (libusb_open(dev, &udev))
+		return;
+	if (libusb_get_bos_descriptor(udev, &bos)) {
+		libusb_close(udev);
+		return;
+	}
+	p->bos = 0;
+	for (i = 0; i < bos->bNumDeviceCaps; i++) {
+		struct libusb_bos_dev_capability_descriptor *cap = bos->dev_capability[i];
+
+		switch (cap->bDevCapabilityType) {
+		case LIBUSB_BT_USB_2_0_EXTENSION:
+			if (libusb_get_usb_2_0_extension_descriptor(NULL, cap, &usb2))
+				break;
+			p->usb2_attributes = usb2->bmAttributes;
+			libusb_free_usb_2_0_extension_descriptor(usb2);
+			break;
+		case LIBUSB_BT_SS_USB_DEVICE_CAPABILITY:
+			if (libusb_get_ss_usb_device_capability_descriptor(NULL, cap, &ss))
+				break;
+			p->u1_exit_us = ss->bU1DevExitLat;
+			p->u2_exit_us = ss->bU2DevExitLat;
+			libusb_free_ss_usb_device_capability_descriptor(ss);
+			break;
+		}
+	}
+	libusb_free_bos_descriptor(bos);
+	libusb_close(udev);
+}
+
+/* audio, video and HID functions notice a wake up; so do isochronous streams */
+static void read_functions(libusb_device *dev, struct power_state *p)
+{
+	struct libusb_config_descriptor *config;
+	char driver[64];
+	int i, j, k;
+
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return;
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		for (j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+
+			switch (alt->bInterfaceClass) {
+			case LIBUSB_CLASS_AUDIO:
+				p->sensitive = "audio";
+				break;
+			case USB_CLASS_VIDEO:
+			case USB_CLASS_AUDIO_VIDEO:
+				p->sensitive = "video";
+				break;
+			case LIBUSB_CLASS_HID:
+				if (!p->sensitive)
+					p->sensitive = "HID";
+				break;
+			}
+			for (k = 0; k < alt->bNumEndpoints && !p->sensitive; k++)
+				if ((alt->endpoint[k].bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) ==
+				    LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+					p->sensitive = "isochronous";
+		}
+		/* by the sysfs name already known, not another scan of sysfs */
+		if (intf->num_altsetting > 0 &&
+		    !get_interface_driver_sysfs(driver, sizeof(driver), p->name,
+						config->bConfigurationValue,
+						intf->altsetting[0].bInterfaceNumber))
+			p->bound++;
+	}
+	libusb_free_config_descriptor(config);
+}
+
+/* ---------------------------------------------------------------------- */
+
+static void print_usb2_lpm(const struct power_state *p)
+{
+	uint32_t a = p->usb2_attributes;
+
+	printf("    USB 2.0 LPM            ");
+	if (p->bos < 0)
+		printf("unknown (BOS not readable)");
+	else if (!(a & USB2_EXT_LPM))
+		printf("not supported");
+	else if (!(a & USB2_EXT_BESL))
+		printf("HIRD");
+	else {
+		printf("BESL");
+		if (a & USB2_EXT_BASELINE_BESL_VALID)
+			printf(", baseline %u us", besl_us[(a >> 8) & 0xf]);
+		if (a & USB2_EXT_DEEP_BESL_VALID)
+			printf(", deep %u us", besl_us[(a >> 12) & 0xf]);
+	}
+	if (p->usb2_lpm[0])
+		printf(", hardware LPM %s", p->usb2_lpm);
+	printf("\n");
+}
+
+static void print_usb3_lpm(const struct power_state *p)
+{
+	printf("    U1/U2                  ");
+	if (p->u1_exit_us >= 0)
+		printf("exit latency %d/%d us", p->u1_exit_us, p->u2_exit_us);
+	else
+		printf("exit latency unknown");
+	if (p->u1[0] || p->u2[0])
+		printf(", U1 %s, U2 %s", p->u1[0] ? p->u1 : "?", p->u2[0] ? p->u2 : "?");
+	if (p->permit[0])
+		printf(", port permits %s", p->permit);
+	printf("\n");
+}
+
+/*
+ * Show the runtime PM and LPM settings of a device next to the LPM
+ * capabilities in its BOS, and flag settings that likely cost wake up
+ * latency or power.  Without -v only devices with a finding are shown.
+ */
+int lsusb_power_audit(libusb_device *dev)
+{
+	struct power_state p;
+	int speed = libusb_get_device_speed(dev);
+	char flags[4][128];
+	int nflags = 0, i;
+
+	memset(&p, 0, sizeof(p));
+	if (get_sysfs_name(p.name, sizeof(p.name), dev))
+		return 1;
+	read_power_attrs(&p);
+	read_bos(dev, &p);
+	read_functions(dev, &p);
+
+	if (p.sensitive && !strcmp(p.control, "auto") &&
+	    p.delay_ms >= 0 && p.delay_ms <= AGGRESSIVE_AUTOSUSPEND_MS) {
+		snprintf(flags[nflags], sizeof(flags[0]),
+			 "%s device autosuspends after %d ms idle",
+			 p.sensitive, p.delay_ms);
+		nflags++;
+	}
+	if (p.sensitive && !strcmp(p.u2, "enabled") &&
+	    p.u2_exit_us >= SLOW_U2_EXIT_US) {
+		snprintf(flags[nflags], sizeof(flags[0]),
+			 "%s device has U2 enabled with a %d us exit latency",
+			 p.sensitive, p.u2_exit_us);
+		nflags++;
+	}
+	if (!strcmp(p.control, "on") && !p.bound && strncmp(p.name, "usb", 3)) {
+		snprintf(flags[nflags], sizeof(flags[0]),
+			 "no driver bound, but power/control is \"on\"");
+		nflags++;
+	}
+	if (p.bos >= 0 && (p.usb2_attributes & USB2_EXT_LPM) &&
+	    speed == LIBUSB_SPEED_HIGH && !strcmp(p.usb2_lpm, "disabled")) {
+		snprintf(flags[nflags], sizeof(flags[0]),
+			 "USB 2.0 LPM capable, but hardware LPM is disabled");
+		nflags++;
+	}
+
+	if (!nflags && !verblevel)
+		return 0;
+
+	printf("Power audit for %s:\n", p.name);
+	printf("    power/control          %s", p.control[0] ? p.control : "unknown");
+	if (p.delay_ms >= 0)
+		printf(", autosuspend delay %d ms", p.delay_ms);
+	if (p.status[0])
+		printf(", %s", p.status);
+	printf("\n");
+	if (speed == LIBUSB_SPEED_HIGH || p.usb2_lpm[0])
+		print_usb2_lpm(&p);
+	if (speed >= LIBUSB_SPEED_SUPER)
+		print_usb3_lpm(&p);
+	for (i = 0; i < nflags; i++)
+		printf("    ** %s **\n", flags[i]);
+	return 0;
+}
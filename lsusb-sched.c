@@ -0,0 +1,401 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Periodic schedule report for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+#include "bandwidth.h"
+#include "sched.h"
+
+#define MAX_SCHED_DEVS		128
+#define MAX_SCHED_EPS		512
+
+struct sched_dev {
+	libusb_device *dev;
+	struct libusb_config_descriptor *config;
+	char name[64];			/* sysfs name, empty if unknown */
+	int speed;
+	int tt;
+};
+
+/* a periodic endpoint of an active alt setting */
+struct sched_entry {
+	struct sched_ep e;
+	unsigned int dev;
+	uint8_t ifnum;
+	uint8_t epaddr;
+	int placed;
+};
+
+/* transaction translators: a hub (and port, for multi-TT hubs) */
+struct sched_tt {
+	libusb_device *hub;
+	int port;
+};
+
+struct sched_bus {
+	struct sched s;
+	struct sched_dev devs[MAX_SCHED_DEVS];
+	unsigned int ndevs;
+	struct sched_entry eps[MAX_SCHED_EPS];
+	unsigned int neps;
+	struct sched_tt tts[SCHED_MAX_TTS];
+	unsigned int ntts;
+};
+
+/* ---------------------------------------------------------------------- */
+
+static int find_tt(struct sched_bus *b, libusb_device *hub, int port)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->ntts; i++)
+		if (b->tts[i].hub == hub && b->tts[i].port == port)
+			return i;
+	if (b->ntts == SCHED_MAX_TTS)
+		return -1;
+	b->tts[b->ntts].hub = hub;
+	b->tts[b->ntts].port = port;
+	return b->ntts++;
+}
+
+/*
+ * The TT that full and low speed traffic of a device goes through: that
+ * of the nearest high speed hub, per port if it is a multi-TT hub.  xHCI
+ * root ports schedule full speed devices themselves, which is modelled as
+ * a TT per root port.
+ */
+static int device_tt(struct sched_bus *b, libusb_device *dev)
+{
+	libusb_device *child = dev, *parent;
+	struct libusb_device_descriptor desc;
+
+	while ((parent = libusb_get_parent(child))) {
+		if (!libusb_get_parent(parent))
+			return find_tt(b, parent, libusb_get_port_number(child));
+		if (libusb_get_device_speed(parent) == LIBUSB_SPEED_HIGH) {
+			if (libusb_get_device_descriptor(parent, &desc))
+				return -1;
+			return find_tt(b, parent, desc.bDeviceProtocol == 2 ?
+				       libusb_get_port_number(child) : 0);
+		}
+		child = parent;
+	}
+	return -1;
+}
+
+static int current_alt(const struct sched_dev *d, unsigned int ifnum)
+{
+	char name[80];
+	int alt;
+
+	if (!d->name[0])
+		return 0;
+	snprintf(name, sizeof(name), "%s:%u.%u", d->name,
+		 d->config->bConfigurationValue, ifnum);
+	alt = read_sysfs_attr_int(name, "bAlternateSetting");
+	return alt < 0 ? 0 : alt;
+}
+
+static const struct libusb_interface_descriptor *
+find_alt(const struct libusb_interface *intf, int alt)
+{
+	int i;
+
+	for (i = 0; i < intf->num_altsetting; i++)
+		if (intf->altsetting[i].bAlternateSetting == alt)
+			return &intf->altsetting[i];
+	return NULL;
+}
+
+static int has_periodic(const struct libusb_interface *intf)
+{
+	int i, j;
+
+	/* isochronous and interrupt transfer types both have bit 0 set */
+	for (i = 0; i < intf->num_altsetting; i++)
+		for (j = 0; j < intf->altsetting[i].bNumEndpoints; j++)
+			if (intf->altsetting[i].endpoint[j].bmAttributes & 1)
+				return 1;
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* peak load of a schedule, in percent of the tightest budget */
+static unsigned int peak_percent(const struct sched *s, unsigned int ntts)
+{
+	unsigned int i, j, peak = 0, p;
+
+	for (i = 0; i < s->nslots; i++) {
+		p = s->load[i] * 100 / s->budget;
+		if (p > peak)
+			peak = p;
+	}
+	for (i = 0; i < ntts; i++)
+		for (j = 0; j < SCHED_FRAMES; j++) {
+			p = s->tt_load[i][j] * 100 / s->tt_budget;
+			if (p > peak)
+				peak = p;
+		}
+	return peak;
+}
+
+/* add the periodic endpoints of one alt setting, -1 if one does not fit */
+static int add_alt(struct sched *s, const struct sched_dev *d,
+		   const struct libusb_interface_descriptor *alt,
+		   struct sched_entry *eps, unsigned int *neps)
+{
+	struct sched_ep e;
+	int i, ret = 0;
+
+	for (i = 0; i < alt->bNumEndpoints; i++) {
+		if (sched_ep_init(&e, &alt->endpoint[i], s, d->speed, d->tt))
+			continue;
+		if (sched_add(s, &e))
+			ret = -1;
+		if (eps && *neps < MAX_SCHED_EPS) {
+			eps[*neps].e = e;
+			eps[*neps].ifnum = alt->bInterfaceNumber;
+			eps[*neps].epaddr = alt->endpoint[i].bEndpointAddress;
+			eps[*neps].placed = ret == 0;
+			(*neps)++;
+		}
+		if (ret)
+			break;
+	}
+	return ret;
+}
+
+static void print_load(const struct sched_bus *b)
+{
+	const struct sched *s = &b->s;
+	unsigned int i, j, peak, sum, load;
+	unsigned int ufr = s->nslots == SCHED_SLOTS ? SCHED_UFRAMES : 1;
+	unsigned int frames = s->nslots / ufr;
+
+	if (ufr == 1) {
+		/* full speed bus: one row of frames */
+		for (i = 0; i < frames; i += 8) {
+			printf("  Frame %2u-%-2u ", i, i + 7);
+			for (j = i; j < i + 8; j++)
+				printf(" %4u%%", s->load[j] * 100 / s->budget);
+			printf("\n");
+		}
+	} else {
+		printf("  Microframe  ");
+		for (j = 0; j < ufr; j++)
+			printf(" %5u", j);
+		printf("\n");
+		printf("  Peak        ");
+		for (j = 0; j < ufr; j++) {
+			peak = 0;
+			for (i = 0; i < frames; i++)
+				if (s->load[i * ufr + j] > peak)
+					peak = s->load[i * ufr + j];
+			printf(" %4u%%", peak * 100 / s->budget);
+		}
+		printf("\n  Mean        ");
+		for (j = 0; j < ufr; j++) {
+			sum = 0;
+			for (i = 0; i < frames; i++)
+				sum += s->load[i * ufr + j];
+			printf(" %4u%%", sum * 100 / frames / s->budget);
+		}
+		printf("\n");
+		if (verblevel) {
+			for (i = 0; i < frames; i++) {
+				printf("  Frame %2u    ", i);
+				for (j = 0; j < ufr; j++)
+					printf(" %4u%%", s->load[i * ufr + j] * 100 / s->budget);
+				printf("\n");
+			}
+		}
+	}
+
+	for (i = 0; i < b->ntts; i++) {
+		peak = 0;
+		for (j = 0; j < SCHED_FRAMES; j++) {
+			load = s->tt_load[i][j];
+			if (load > peak)
+				peak = load;
+		}
+		printf("  TT of hub %03u", libusb_get_device_address(b->tts[i].hub));
+		if (b->tts[i].port)
+			printf(" port %u", b->tts[i].port);
+		printf(": peak %u%% of %u full speed bytes per frame\n",
+		       peak * 100 / s->tt_budget, s->tt_budget);
+	}
+}
+
+/*
+ * Try every other alt setting of every interface against the current
+ * schedule, in the order the interfaces appear, and report the first one
+ * that the host could not fit.
+ */
+static void print_what_if(struct sched_bus *b)
+{
+	unsigned int d, i, k, first_dev = 0, first_if = 0;
+	int a, first_alt = -1;
+	struct sched trial;
+
+	printf("  Alt setting changes:\n");
+	for (d = 0; d < b->ndevs; d++) {
+		const struct sched_dev *dev = &b->devs[d];
+
+		for (i = 0; i < dev->config->bNumInterfaces; i++) {
+			const struct libusb_interface *intf = &dev->config->interface[i];
+			const char *sep = "";
+			int ifnum, cur;
+
+			if (intf->num_altsetting < 2 || !has_periodic(intf))
+				continue;
+			ifnum = intf->altsetting[0].bInterfaceNumber;
+			cur = current_alt(dev, ifnum);
+
+			printf("    Device %03u Interface %d (alt %d active):",
+			       libusb_get_device_address(dev->dev), ifnum, cur);
+			for (a = 0; a < intf->num_altsetting; a++) {
+				const struct libusb_interface_descriptor *alt = &intf->altsetting[a];
+
+				if (alt->bAlternateSetting == cur)
+					continue;
+				trial = b->s;
+				for (k = 0; k < b->neps; k++)
+					if (b->eps[k].dev == d && b->eps[k].ifnum == ifnum &&
+					    b->eps[k].placed)
+						sched_remove(&trial, &b->eps[k].e);
+				if (add_alt(&trial, dev, alt, NULL, NULL)) {
+					printf("%s alt %u FAILS", sep, alt->bAlternateSetting);
+					if (first_alt < 0) {
+						first_dev = libusb_get_device_address(dev->dev);
+						first_if = ifnum;
+						first_alt = alt->bAlternateSetting;
+					}
+					break;
+				}
+				printf("%s alt %u fits (peak %u%%)", sep,
+				       alt->bAlternateSetting,
+				       peak_percent(&trial, b->ntts));
+				sep = ",";
+			}
+			printf("\n");
+		}
+	}
+	if (first_alt >= 0)
+		printf("  First failing change: Device %03u Interface %u alt %d\n",
+		       first_dev, first_if, first_alt);
+	else
+		printf("  Every alt setting fits the current schedule\n");
+}
+
+static void do_bus(struct sched_bus *b, libusb_device *root)
+{
+	unsigned int d, i, k, nplaced = 0;
+	int bus_speed = libusb_get_device_speed(root);
+
+	sched_init(&b->s, bus_speed);
+	printf("Bus %03u: %s, %u %s of %u periodic bytes\n",
+	       libusb_get_bus_number(root), bw_speed_name(bus_speed), b->s.nslots,
+	       b->s.nslots == SCHED_SLOTS ? "microframes" : "frames", b->s.budget);
+
+	/* the current schedule, in enumeration order */
+	for (d = 0; d < b->ndevs; d++) {
+		struct sched_dev *dev = &b->devs[d];
+
+		dev->tt = dev->speed < LIBUSB_SPEED_HIGH ? device_tt(b, dev->dev) : -1;
+		for (i = 0; i < dev->config->bNumInterfaces; i++) {
+			const struct libusb_interface *intf = &dev->config->interface[i];
+			const struct libusb_interface_descriptor *alt;
+			unsigned int first = b->neps;
+
+			if (intf->num_altsetting < 1)
+				continue;
+			alt = find_alt(intf, current_alt(dev, intf->altsetting[0].bInterfaceNumber));
+			if (!alt)
+				continue;
+			add_alt(&b->s, dev, alt, b->eps, &b->neps);
+			for (k = first; k < b->neps; k++) {
+				b->eps[k].dev = d;
+				if (b->eps[k].placed) {
+					nplaced++;
+					continue;
+				}
+				printf("  ** Device %03u EP 0x%02x does not fit the schedule **\n",
+				       libusb_get_device_address(dev->dev), b->eps[k].epaddr);
+			}
+		}
+	}
+
+	printf("  %u periodic endpoints scheduled, peak load %u%%\n",
+	       nplaced, peak_percent(&b->s, b->ntts));
+	print_load(b);
+	print_what_if(b);
+}
+
+/*
+ * Rebuild the periodic schedule of every bus (or just busnum) from the
+ * active alt settings and find the alt setting changes that would not
+ * fit.
+ */
+int lsusb_schedule(libusb_context *ctx, int busnum)
+{
+	libusb_device **list;
+	struct sched_bus *b;
+	ssize_t num_devs, i, j;
+	int found = 0;
+
+	num_devs = libusb_get_device_list(ctx, &list);
+	if (num_devs < 0)
+		return 1;
+	b = malloc(sizeof(*b));
+	if (!b) {
+		libusb_free_device_list(list, 1);
+		return 1;
+	}
+
+	for (i = 0; i < num_devs; i++) {
+		libusb_device *root = list[i];
+		uint8_t bnum = libusb_get_bus_number(root);
+
+		if (libusb_get_parent(root))
+			continue;
+		if (busnum != -1 && busnum != bnum)
+			continue;
+
+		memset(b, 0, sizeof(*b));
+		for (j = 0; j < num_devs && b->ndevs < MAX_SCHED_DEVS; j++) {
+			struct sched_dev *d = &b->devs[b->ndevs];
+
+			if (libusb_get_bus_number(list[j]) != bnum || list[j] == root)
+				continue;
+			if (libusb_get_active_config_descriptor(list[j], &d->config))
+				continue;
+			d->dev = list[j];
+			d->speed = libusb_get_device_speed(list[j]);
+			if (get_sysfs_name(d->name, sizeof(d->name), list[j]))
+				d->name[0] = 0;
+			b->ndevs++;
+		}
+
+		if (found++)
+			printf("\n");
+		do_bus(b, root);
+
+		for (j = 0; j < (ssize_t)b->ndevs; j++)
+			libusb_free_config_descriptor(b->devs[j].config);
+	}
+
+	free(b);
+	libusb_free_device_list(list, 1);
+	return !found;
+}
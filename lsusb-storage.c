@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * USB mass storage transport audit for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+#include "bandwidth.h"
+
+#define USB_PR_BULK			0x50	/* Bulk-only (BOT) */
+#define USB_PR_UAS			0x62	/* USB Attached SCSI */
+
+/* what we learned about one mass storage interface */
+struct storage_intf {
+	unsigned int ifnum;
+	int bot_alt;			/* -1 if none */
+	int uas_alt;			/* -1 if none */
+	unsigned int streams;		/* of the UAS alt, 0 if none */
+	int cur_alt;			/* from sysfs, -1 if unknown */
+	char driver[64];		/* empty if unbound */
+};
+
+/* ---------------------------------------------------------------------- */
+
+/* number of streams a bulk endpoint supports, from its SS companion */
+static unsigned int ep_streams(const struct libusb_endpoint_descriptor *ep)
+{
+	const unsigned char *buf = ep->extra;
+	int size = ep->extra_length;
+
+	while (buf && size >= 2) {
+		if (buf[0] < 2 || buf[0] > size)
+			break;
+		if (buf[1] == USB_DT_SS_ENDPOINT_COMP && buf[0] >= 6)
+			return (buf[3] & 0x1f) ? 1U << (buf[3] & 0x1f) : 0;
+		size -= buf[0];
+		buf += buf[0];
+	}
+	return 0;
+}
+
+/* the smallest stream count of the alt setting's bulk endpoints */
+static unsigned int alt_streams(const struct libusb_interface_descriptor *alt)
+{
+	unsigned int streams = 0, n;
+	int i, first = 1;
+
+	for (i = 0; i < alt->bNumEndpoints; i++) {
+		const struct libusb_endpoint_descriptor *ep = &alt->endpoint[i];
+
+		if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) !=
+		    LIBUSB_TRANSFER_TYPE_BULK)
+			continue;
+		n = ep_streams(ep);
+		if (first || n < streams)
+			streams = n;
+		first = 0;
+	}
+	return streams;
+}
+
+/* is UAS turned off for this device by the usb-storage quirks parameter? */
+static int uas_quirked(uint16_t vendor, uint16_t product)
+{
+	char buf[1024], id[16], *p;
+	FILE *f;
+	size_t len;
+
+	f = fopen("/sys/module/usb_storage/parameters/quirks", "r");
+	if (!f)
+		return 0;
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[len] = 0;
+	for (p = buf; *p; p++)
+		*p = tolower((unsigned char)*p);
+
+	/* entries are "vid:pid:flags" separated by commas */
+	snprintf(id, sizeof(id), "%04x:%04x:", vendor, product);
+	for (p = buf; (p = strstr(p, id)); p += strlen(id)) {
+		char *flags = p + strlen(id);
+
+		while (*flags && *flags != ',' && *flags != '\n') {
+			if (*flags == 'u')
+				return 1;
+			flags++;
+		}
+	}
+	return 0;
+}
+
+static void print_reasons(const struct storage_intf *s, int speed,
+			  uint16_t vendor, uint16_t product)
+{
+	if (access("/sys/module/uas", F_OK))
+		printf("    uas driver is not loaded\n");
+	else if (uas_quirked(vendor, product))
+		printf("    UAS disabled by the usb-storage quirks parameter\n");
+	else if (speed >= LIBUSB_SPEED_SUPER && !s->streams)
+		printf("    UAS alt setting has no bulk streams\n");
+	else
+		printf("    UAS refused by a kernel quirk or by a host controller "
+		       "without streams support (see dmesg)\n");
+}
+
+static void print_storage_intf(const struct storage_intf *s, int speed)
+{
+	printf("  Interface %u: ", s->ifnum);
+	if (s->uas_alt >= 0)
+		printf("UAS alt %d (%u streams)", s->uas_alt, s->streams);
+	else
+		printf("BOT only");
+	if (s->bot_alt >= 0 && s->uas_alt >= 0)
+		printf(", BOT alt %d", s->bot_alt);
+	printf(", %s", bw_speed_name(speed));
+	if (s->driver[0])
+		printf(", driver %s", s->driver);
+	else
+		printf(", no driver");
+	if (s->cur_alt >= 0)
+		printf(", alt %d active", s->cur_alt);
+	printf("\n");
+}
+
+/*
+ * Report mass storage interfaces that offer a UAS alt setting but are
+ * driven by usb-storage over Bulk-Only Transport.  With -v every mass
+ * storage interface is listed.
+ */
+int lsusb_uas_audit(libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+	struct libusb_config_descriptor *config;
+	int speed = libusb_get_device_speed(dev);
+	char name[64], intf_name[80];
+	int i, j;
+
+	if (libusb_get_device_descriptor(dev, &desc))
+		return 1;
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return 1;
+	if (get_sysfs_name(name, sizeof(name), dev))
+		name[0] = 0;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+		struct storage_intf s;
+		int stuck;
+
+		if (intf->num_altsetting < 1 ||
+		    intf->altsetting[0].bInterfaceClass != LIBUSB_CLASS_MASS_STORAGE)
+			continue;
+
+		memset(&s, 0, sizeof(s));
+		s.ifnum = intf->altsetting[0].bInterfaceNumber;
+		s.bot_alt = s.uas_alt = -1;
+		for (j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+
+			if (alt->bInterfaceProtocol == USB_PR_BULK && s.bot_alt < 0)
+				s.bot_alt = alt->bAlternateSetting;
+			else if (alt->bInterfaceProtocol == USB_PR_UAS && s.uas_alt < 0) {
+				s.uas_alt = alt->bAlternateSetting;
+				s.streams = alt_streams(alt);
+			}
+		}
+		s.driver[0] = 0;
+		s.cur_alt = -1;
+		if (name[0]) {
+			snprintf(intf_name, sizeof(intf_name), "%s:%d.%u", name,
+				 config->bConfigurationValue, s.ifnum);
+			if (get_interface_driver_sysfs(s.driver, sizeof(s.driver), name,
+						       config->bConfigurationValue, s.ifnum))
+				s.driver[0] = 0;
+			s.cur_alt = read_sysfs_attr_int(intf_name, "bAlternateSetting");
+		}
+
+		stuck = s.uas_alt >= 0 && !strcmp(s.driver, "usb-storage");
+		if (!stuck && !verblevel)
+			continue;
+
+		print_storage_intf(&s, speed);
+		if (stuck) {
+			printf("    ** UAS capable but bound to usb-storage **\n");
+			print_reasons(&s, speed, desc.idVendor, desc.idProduct);
+		}
+	}
+
+	libusb_free_config_descriptor(config);
+	return 0;
+}
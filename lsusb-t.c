@@ -6,10 +6,12 @@
 #include <dirent.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stddef.h>
+#include <time.h>
 
 #include "list.h"
 #include "lsusb.h"
@@ -19,6 +21,29 @@
 #define MY_PATH_MAX 4096
 #define MY_PARAM_MAX 64
 
+/* activity counters sampled by --stats, all but urbnum in milliseconds */
+enum {
+	STAT_URBNUM,
+	STAT_ACTIVE,
+	STAT_CONNECTED,
+	STAT_SUSPENDED,
+	STAT_MAX
+};
+
+static const char * const stat_files[STAT_MAX] = {
+	"urbnum",
+	"power/active_duration",
+	"power/connected_duration",
+	"power/runtime_suspended_time",
+};
+
+struct usbstats {
+	int fd[STAT_MAX];		/* kept open, re-read with pread() */
+	unsigned long long last[STAT_MAX];
+	unsigned long long delta[STAT_MAX];
+	int gone;
+};
+
 struct usbinterface {
 	struct list_head list;
 	struct usbinterface *next;
@@ -70,6 +95,7 @@ struct usbdevice {
 
 	char name[MY_SYSFS_FILENAME_LEN];
 	char driver[MY_SYSFS_FILENAME_LEN];
+	struct usbstats *stats;
 };
 
 struct usbbusnode {
@@ -87,6 +113,15 @@ struct usbbusnode {
 
 	char name[MY_SYSFS_FILENAME_LEN];
 	char driver[MY_SYSFS_FILENAME_LEN];
+	struct usbstats *stats;
+
+	/* periodic bandwidth, only known from the devices file */
+	int alloc_valid;
+	unsigned int alloc_us;
+	unsigned int alloc_max_us;
+	unsigned int alloc_pct;
+	unsigned int alloc_int;
+	unsigned int alloc_iso;
 };
 
 #define SYSFS_INTu(de,tgt, name) do { tgt->name = read_sysfs_file_int(de,#name,10); } while(0)
@@ -98,6 +133,7 @@ LIST_HEAD(usbdevlist);
 static struct usbbusnode *usbbuslist;
 
 static const char sys_bus_usb_devices[] = "/sys/bus/usb/devices";
+static const char usb_devices_file[] = "/sys/kernel/debug/usb/devices";
 static int indent;
 
 #if 0
@@ -139,8 +175,12 @@ static const char *bDeviceClass_to_str(unsigned int dc)
 static void print_usbbusnode(struct usbbusnode *b)
 {
 	char vendor[128], product[128];
-	printf("/:  Bus %02u.Port %u: Dev %u, Class=%s, Driver=%s/%up, %sM\n", b->busnum, 1,
+	printf("/:  Bus %02u.Port %u: Dev %u, Class=%s, Driver=%s/%up, %sM", b->busnum, 1,
 	       b->devnum, bDeviceClass_to_str(b->bDeviceClass), b->driver, b->maxchild, b->speed);
+	if (b->alloc_valid)
+		printf(", Alloc=%u/%u us (%u%%), #Int=%u, #Iso=%u", b->alloc_us, b->alloc_max_us,
+		       b->alloc_pct, b->alloc_int, b->alloc_iso);
+	printf("\n");
 	if (verblevel >= 1) {
 		get_vendor_string(vendor, sizeof(vendor), b->idVendor);
 		get_product_string(product, sizeof(product), b->idVendor, b->idProduct);
@@ -287,21 +327,22 @@ static void append_busnode(struct usbbusnode *new)
 		usbbuslist = new;
 }
 
-static void add_usb_interface(const char *d_name)
+static struct usbinterface *new_usb_interface(const char *d_name)
 {
 	struct usbinterface *e;
 	const char *p;
-	char *pn, driver[MY_PATH_MAX], link[MY_PATH_MAX];
+	char *pn;
 	unsigned long i;
-	int l;
 	p = strchr(d_name, ':');
+	if (!p)
+		return NULL;
 	p++;
 	i = strtoul(p, &pn, 10);
 	if (!pn || p == pn)
-		return;
+		return NULL;
 	e = malloc(sizeof(struct usbinterface));
 	if (!e)
-		return;
+		return NULL;
 	memset(e, 0, sizeof(struct usbinterface));
 	e->configuration = i;
 	p = pn + 1;
@@ -309,11 +350,23 @@ static void add_usb_interface(const char *d_name)
 	if (!pn || p == pn)
 	{
 		free(e);
-		return;
+		return NULL;
 	}
 	e->ifnum = i;
 	if (snprintf(e->name, MY_SYSFS_FILENAME_LEN, "%s", d_name) >= MY_SYSFS_FILENAME_LEN)
 		printf("warning: '%s' truncated to '%s'\n", d_name, e->name);
+	return e;
+}
+
+static void add_usb_interface(const char *d_name)
+{
+	struct usbinterface *e;
+	const char *p;
+	char driver[MY_PATH_MAX], link[MY_PATH_MAX];
+	int l;
+	e = new_usb_interface(d_name);
+	if (!e)
+		return;
 	SYSFS_INTu(d_name, e, bAlternateSetting);
 	SYSFS_INTx(d_name, e, bInterfaceClass);
 	SYSFS_INTx(d_name, e, bInterfaceNumber);
@@ -337,20 +390,19 @@ static void add_usb_interface(const char *d_name)
 	list_add_tail(&e->list, &interfacelist);
 }
 
-static void add_usb_device(const char *d_name)
+static struct usbdevice *new_usb_device(const char *d_name)
 {
 	struct usbdevice *d;
 	const char *p;
-	char *pn, driver[MY_PATH_MAX], link[MY_PATH_MAX];
+	char *pn;
 	unsigned long i;
-	int l;
 	p = d_name;
 	i = strtoul(p, &pn, 10);
 	if (!pn || p == pn)
-		return;
+		return NULL;
 	d = malloc(sizeof(struct usbdevice));
 	if (!d)
-		return;
+		return NULL;
 	memset(d, 0, sizeof(struct usbdevice));
 	d->busnum = i;
 	while (*pn) {
@@ -363,6 +415,18 @@ static void add_usb_device(const char *d_name)
 	}
 	if (snprintf(d->name, MY_SYSFS_FILENAME_LEN, "%s", d_name) >= MY_SYSFS_FILENAME_LEN)
 		printf("warning: '%s' truncated to '%s'\n", d_name, d->name);
+	return d;
+}
+
+static void add_usb_device(const char *d_name)
+{
+	struct usbdevice *d;
+	const char *p;
+	char driver[MY_PATH_MAX], link[MY_PATH_MAX];
+	int l;
+	d = new_usb_device(d_name);
+	if (!d)
+		return;
 	SYSFS_INTu(d_name, d, bConfigurationValue);
 	SYSFS_INTx(d_name, d, bDeviceClass);
 	SYSFS_INTx(d_name, d, bDeviceProtocol);
@@ -420,7 +484,7 @@ static void get_roothub_driver(struct usbbusnode *b, const char *d_name)
 		printf("Can not read driver link for '%s': %d\n", d_name, l);
 }
 
-static void add_usb_bus(const char *d_name)
+static struct usbbusnode *new_usb_bus(const char *d_name)
 {
 	struct usbbusnode *bus;
 	bus = malloc(sizeof(struct usbbusnode));
@@ -429,6 +493,15 @@ static void add_usb_bus(const char *d_name)
 		bus->busnum = strtoul(d_name + 3, NULL, 10);
 		if (snprintf(bus->name, MY_SYSFS_FILENAME_LEN, "%s", d_name) >= MY_SYSFS_FILENAME_LEN)
 			printf("warning: '%s' truncated to '%s'\n", d_name, bus->name);
+	}
+	return bus;
+}
+
+static void add_usb_bus(const char *d_name)
+{
+	struct usbbusnode *bus;
+	bus = new_usb_bus(d_name);
+	if (bus) {
 		SYSFS_INTu(d_name, bus, devnum);
 		SYSFS_INTx(d_name, bus, bDeviceClass);
 		SYSFS_INTx(d_name, bus, idProduct);
@@ -665,39 +738,513 @@ static void print_tree_dev_interface(struct usbdevice *d, struct usbinterface *i
 	}
 	indent -= 3;
 }
-static void print_tree_dev_children(struct usbdevice *d)
+/*
+ * The port attributes the hub driver exports below the hub interface, e.g.
+ * usb1/1-0:1.0/usb1-port2 or 1-1/1-1:1.0/1-1-port3.  Nothing is sent to
+ * the hub, so a suspended hub stays suspended.
+ */
+static void format_port(char *buf, size_t size, const char *hub, const char *intf, unsigned int port)
+{
+	static const char * const attrs[] = {
+		"connect_type", "state", "over_current_count", "usb3_lpm_permit", "quirks", "disable",
+	};
+	char dir[MY_PATH_MAX], val[MY_PARAM_MAX];
+	size_t len = 0;
+	unsigned int n;
+
+	buf[0] = '\0';
+	snprintf(dir, sizeof(dir), "%s/%s/%s-port%u", hub, intf, hub, port);
+	for (n = 0; n < sizeof(attrs) / sizeof(attrs[0]) && len < size; n++) {
+		read_sysfs_file_string(dir, attrs[n], val, sizeof(val));
+		if (!val[0])
+			continue;
+		/* only worth a mention when set */
+		if ((!strcmp(attrs[n], "quirks") && strtoul(val, NULL, 16) == 0) ||
+		    (!strcmp(attrs[n], "disable") && !strcmp(val, "0")))
+			continue;
+		len += snprintf(buf + len, size - len, "%s%s=%s", len ? ", " : "", attrs[n], val);
+	}
+}
+
+/*
+ * Where a device sits, e.g. "Bus 1, Port 2 (05e3:0608 hub), Port 3
+ * [connect_type=hotplug]", from the hubs above it and its port's
+ * attributes.  Only sysfs is read, so the device itself may be gone.
+ */
+int lsusb_t_context(char *buf, size_t size, const char *name)
 {
+	char hub[MY_SYSFS_FILENAME_LEN], intf[MY_SYSFS_FILENAME_LEN], val[MY_PARAM_MAX];
+	char vendor[128], product[128], port[256];
+	unsigned int busnum, portnum, vid, pid;
+	const char *p = name;
+	size_t len;
+	int n;
+
+	if (sscanf(name, "%u-%u%n", &busnum, &portnum, &n) != 2)
+		return -1;
+	len = snprintf(buf, size, "Bus %u", busnum);
+	snprintf(hub, sizeof(hub), "usb%u", busnum);
+	snprintf(intf, sizeof(intf), "%u-0:1.0", busnum);
+	for (;;) {
+		p += n;
+		if (len < size)
+			len += snprintf(buf + len, size - len, ", Port %u", portnum);
+		if (*p != '.')
+			break;
+		/* an intermediate hub */
+		snprintf(hub, sizeof(hub), "%.*s", (int)(p - name), name);
+		read_sysfs_file_string(hub, "idVendor", val, sizeof(val));
+		vid = strtoul(val, NULL, 16);
+		read_sysfs_file_string(hub, "idProduct", val, sizeof(val));
+		pid = strtoul(val, NULL, 16);
+		get_vendor_string(vendor, sizeof(vendor), vid);
+		get_product_string(product, sizeof(product), vid, pid);
+		if (len < size)
+			len += snprintf(buf + len, size - len, " (%04x:%04x %s %s)", vid, pid, vendor, product);
+		read_sysfs_file_string(hub, "bConfigurationValue", val, sizeof(val));
+		snprintf(intf, sizeof(intf), "%s:%s.0", hub, val[0] ? val : "1");
+		if (sscanf(p, ".%u%n", &portnum, &n) != 1)
+			return -1;
+	}
+	format_port(port, sizeof(port), hub, intf, portnum);
+	if (port[0] && len < size)
+		snprintf(buf + len, size - len, " [%s]", port);
+	return 0;
+}
+
+static void print_tree_ports(const char *hub, const char *intf, unsigned int maxchild, struct usbdevice *d);
+
+static void print_tree_dev(struct usbdevice *d, const char *hub, const char *intf)
+{
+	char name[MY_SYSFS_FILENAME_LEN + 8], port[256];
+
+	print_tree_dev_interface(d, d->first_interface);
+	if (verblevel >= 3) {
+		format_port(port, sizeof(port), hub, intf, d->portnum);
+		if (port[0])
+			printf(" %*s%s\n", indent + 3, "    ", port);
+	}
+	snprintf(name, sizeof(name), "%s:%u.0", d->name, d->bConfigurationValue);
+	print_tree_ports(d->name, name, d->maxchild, d->first_child);
+}
+
+/* children in port order; at -vvv empty ports are listed as well */
+static void print_tree_ports(const char *hub, const char *intf, unsigned int maxchild, struct usbdevice *d)
+{
+	char port[256];
+	unsigned int n;
+	int used;
+
 	indent += 4;
-	while (d) {
-		print_tree_dev_interface(d, d->first_interface);
-		print_tree_dev_children(d->first_child);
-		d = d->next;
+	for (n = 1; n <= maxchild; n++) {
+		for (used = 0; d && d->portnum <= n; d = d->next) {
+			print_tree_dev(d, hub, intf);
+			used |= d->portnum == n;
+		}
+		if (verblevel < 3 || used)
+			continue;
+		format_port(port, sizeof(port), hub, intf, n);
+		printf(" %*sPort %u: empty%s%s\n", indent + 3, "|__ ", n, port[0] ? ", " : "", port);
 	}
+	for (; d; d = d->next)
+		print_tree_dev(d, hub, intf);
 	indent -= 4;
 }
 
 static void print_tree(void)
 {
+	char intf[MY_SYSFS_FILENAME_LEN];
 	struct usbbusnode *b = usbbuslist;
 	while (b) {
 		print_usbbusnode(b);
-		if (b->first_child)
-			print_tree_dev_children(b->first_child);
+		snprintf(intf, sizeof(intf), "%u-0:1.0", b->busnum);
+		print_tree_ports(b->name, intf, b->maxchild, b->first_child);
 		b = b->next;
 	}
 }
 
-int lsusb_t(void)
+/* ---------------------------------------------------------------------- */
+
+/* the value of "key=" in a line of the devices file */
+static const char *devices_field(const char *line, const char *key)
+{
+	const char *p = strstr(line, key);
+	if (!p)
+		return NULL;
+	p += strlen(key);
+	while (*p == ' ')
+		p++;
+	return p;
+}
+
+static unsigned int devices_int(const char *line, const char *key, int base)
 {
-	DIR *sbud = opendir(sys_bus_usb_devices);
+	const char *p = devices_field(line, key);
+	return p ? strtoul(p, NULL, base) : 0;
+}
+
+/* a word, or the rest of the line for the free text S: strings */
+static void devices_str(const char *line, const char *key, char *buf, size_t size)
+{
+	const char *p = devices_field(line, key);
+	size_t n = 0;
+	buf[0] = '\0';
+	if (!p)
+		return;
+	while (p[n] && p[n] != '\n' && (line[0] == 'S' || p[n] != ' '))
+		n++;
+	if (n >= size)
+		n = size - 1;
+	memcpy(buf, p, n);
+	buf[n] = '\0';
+}
+
+static struct usbdevice *find_devnum(unsigned int busnum, unsigned int devnum)
+{
+	struct list_head *l;
+	struct usbdevice *d;
+	for (l = usbdevlist.next; l != &usbdevlist; l = l->next) {
+		d = list_entry(l, struct usbdevice, list);
+		if (d->busnum == busnum && d->devnum == devnum)
+			return d;
+	}
+	return NULL;
+}
+
+/*
+ * Build the tree from the single debugfs devices file instead of the
+ * sysfs attribute files; see Documentation/driver-api/usb/usb.rst.  Names
+ * are made up the way sysfs names devices and interfaces, so the rest
+ * works unchanged.  Returns non-zero if the file can't be used.
+ */
+static int read_devices_file(void)
+{
+	struct usbbusnode *bus = NULL;
+	struct usbdevice *d = NULL, *parent;
+	struct usbinterface *e;
+	char *line = NULL, name[MY_SYSFS_FILENAME_LEN], buf[MY_PARAM_MAX];
+	size_t line_size = 0;
+	unsigned int busnum = 0, level, port, prnt, devnum, cfg = 0;
+	int active = 0;
+	FILE *f;
+
+	f = fopen(usb_devices_file, "r");
+	if (!f)
+		return 1;
+	/* S: lines hold up to 126 UTF-16 units as UTF-8, so no fixed buffer */
+	while (getline(&line, &line_size, f) > 0) {
+		switch (line[0]) {
+		case 'T':
+			busnum = devices_int(line, "Bus=", 10);
+			level = devices_int(line, "Lev=", 10);
+			prnt = devices_int(line, "Prnt=", 10);
+			port = devices_int(line, "Port=", 10) + 1;
+			devnum = devices_int(line, "Dev#=", 10);
+			active = 0;
+			d = NULL;
+			if (level == 0) {
+				snprintf(name, sizeof(name), "usb%u", busnum);
+				bus = new_usb_bus(name);
+				if (!bus)
+					break;
+				bus->devnum = devnum;
+				bus->maxchild = devices_int(line, "MxCh=", 10);
+				devices_str(line, "Spd=", bus->speed, sizeof(bus->speed));
+				append_busnode(bus);
+				get_roothub_driver(bus, name);
+				break;
+			}
+			parent = level > 1 ? find_devnum(busnum, prnt) : NULL;
+			if (parent)
+				snprintf(name, sizeof(name), "%s.%u", parent->name, port);
+			else
+				snprintf(name, sizeof(name), "%u-%u", busnum, port);
+			d = new_usb_device(name);
+			if (!d)
+				break;
+			d->devnum = devnum;
+			d->maxchild = devices_int(line, "MxCh=", 10);
+			devices_str(line, "Spd=", d->speed, sizeof(d->speed));
+			list_add_tail(&d->list, &usbdevlist);
+			break;
+		case 'B':
+			if (!bus || d)
+				break;
+			bus->alloc_us = devices_int(line, "Alloc=", 10);
+			bus->alloc_max_us = devices_int(line, "/", 10);
+			bus->alloc_pct = devices_int(line, "(", 10);
+			bus->alloc_int = devices_int(line, "#Int=", 10);
+			bus->alloc_iso = devices_int(line, "#Iso=", 10);
+			bus->alloc_valid = 1;
+			break;
+		case 'D':
+			if (bus && !d)
+				bus->bDeviceClass = devices_int(line, "Cls=", 16);
+			if (!d)
+				break;
+			devices_str(line, "Ver=", d->version, sizeof(d->version));
+			d->bDeviceClass = devices_int(line, "Cls=", 16);
+			d->bDeviceSubClass = devices_int(line, "Sub=", 16);
+			d->bDeviceProtocol = devices_int(line, "Prot=", 16);
+			d->bMaxPacketSize0 = devices_int(line, "MxPS=", 10);
+			d->bNumConfigurations = devices_int(line, "#Cfgs=", 10);
+			break;
+		case 'P':
+			if (bus && !d) {
+				bus->idVendor = devices_int(line, "Vendor=", 16);
+				bus->idProduct = devices_int(line, "ProdID=", 16);
+			}
+			if (!d)
+				break;
+			d->idVendor = devices_int(line, "Vendor=", 16);
+			d->idProduct = devices_int(line, "ProdID=", 16);
+			devices_str(line, "Rev=", buf, sizeof(buf));
+			d->bcdDevice = strtoul(buf, NULL, 16) << 8;
+			if (strchr(buf, '.'))
+				d->bcdDevice |= strtoul(strchr(buf, '.') + 1, NULL, 16);
+			break;
+		case 'S':
+			if (!d)
+				break;
+			if (devices_field(line, "Manufacturer="))
+				devices_str(line, "Manufacturer=", d->manufacturer, sizeof(d->manufacturer));
+			else if (devices_field(line, "Product="))
+				devices_str(line, "Product=", d->product, sizeof(d->product));
+			else if (devices_field(line, "SerialNumber="))
+				devices_str(line, "SerialNumber=", d->serial, sizeof(d->serial));
+			break;
+		case 'C':
+			/* only the active configuration is in sysfs */
+			active = line[2] == '*';
+			if (!active)
+				break;
+			cfg = devices_int(line, "Cfg#=", 10);
+			if (!d)
+				break;
+			d->bConfigurationValue = cfg;
+			d->bNumInterfaces = devices_int(line, "#Ifs=", 10);
+			d->bmAttributes = devices_int(line, "Atr=", 16);
+			devices_str(line, "MxPwr=", d->bMaxPower, sizeof(d->bMaxPower));
+			break;
+		case 'I':
+			if (!active || line[2] != '*')
+				break;
+			if (d)
+				snprintf(name, sizeof(name), "%s:%u.%u", d->name, cfg,
+					 devices_int(line, "If#=", 10));
+			else
+				snprintf(name, sizeof(name), "%u-0:%u.%u", busnum, cfg,
+					 devices_int(line, "If#=", 10));
+			e = new_usb_interface(name);
+			if (!e)
+				break;
+			e->bInterfaceNumber = e->ifnum;
+			e->bAlternateSetting = devices_int(line, "Alt=", 10);
+			e->bNumEndpoints = devices_int(line, "#EPs=", 10);
+			e->bInterfaceClass = devices_int(line, "Cls=", 16);
+			e->bInterfaceSubClass = devices_int(line, "Sub=", 16);
+			e->bInterfaceProtocol = devices_int(line, "Prot=", 16);
+			devices_str(line, "Driver=", e->driver, sizeof(e->driver));
+			if (!strcmp(e->driver, "(none)"))
+				e->driver[0] = '\0';
+			list_add_tail(&e->list, &interfacelist);
+			break;
+		}
+	}
+	free(line);
+	fclose(f);
+	return usbbuslist == NULL;
+}
+
+static int build_tree(void)
+{
+	DIR *sbud;
+	/* one read instead of a dozen files per device, when readable */
+	if (!read_devices_file()) {
+		connect_devices();
+		sort_devices();
+		sort_busses();
+		return 0;
+	}
+	sbud = opendir(sys_bus_usb_devices);
 	if (sbud) {
 		walk_usb_devices(sbud);
 		closedir(sbud);
 		connect_devices();
 		sort_devices();
 		sort_busses();
-		print_tree();
 	} else
 		perror(sys_bus_usb_devices);
 	return sbud == NULL;
 }
+
+int lsusb_t(void)
+{
+	if (build_tree())
+		return 1;
+	print_tree();
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static struct usbstats *open_stats(const char *d_name)
+{
+	struct usbstats *s;
+	char path[MY_PATH_MAX];
+	int i;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	for (i = 0; i < STAT_MAX; i++) {
+		snprintf(path, MY_PATH_MAX, "%s/%s/%s", sys_bus_usb_devices, d_name, stat_files[i]);
+		/* the power/ files are missing without CONFIG_PM */
+		s->fd[i] = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	return s;
+}
+
+static void sample_stats(struct usbstats *s)
+{
+	unsigned long long v;
+	char buf[24];
+	ssize_t r;
+	int i;
+
+	if (!s || s->gone)
+		return;
+	for (i = 0; i < STAT_MAX; i++) {
+		if (s->fd[i] < 0)
+			continue;
+		/* sysfs attributes regenerate their contents at offset 0 */
+		r = pread(s->fd[i], buf, sizeof(buf) - 1, 0);
+		if (r <= 0) {
+			s->gone = 1;	/* unplugged since the tree was built */
+			return;
+		}
+		buf[r] = '\0';
+		v = strtoull(buf, NULL, 10);
+		s->delta[i] = v - s->last[i];
+		s->last[i] = v;
+	}
+}
+
+static void print_stats(const struct usbstats *s, unsigned long long ms)
+{
+	if (!s) {
+		printf("\n");
+		return;
+	}
+	if (s->gone) {
+		printf(", disconnected\n");
+		return;
+	}
+	printf(", %llu URB/s", s->delta[STAT_URBNUM] * 1000 / ms);
+	if (s->fd[STAT_ACTIVE] >= 0 && s->fd[STAT_CONNECTED] >= 0 &&
+	    s->delta[STAT_CONNECTED])
+		printf(", active %llu%%",
+		       s->delta[STAT_ACTIVE] * 100 / s->delta[STAT_CONNECTED]);
+	if (s->fd[STAT_SUSPENDED] >= 0)
+		printf(", suspended %llu%%",
+		       (s->delta[STAT_SUSPENDED] > ms ? ms : s->delta[STAT_SUSPENDED]) * 100 / ms);
+	printf("\n");
+}
+
+static void for_each_stats(struct usbdevice *d, void (*fn)(struct usbdevice *))
+{
+	while (d) {
+		fn(d);
+		for_each_stats(d->first_child, fn);
+		d = d->next;
+	}
+}
+
+static void open_dev_stats(struct usbdevice *d)
+{
+	d->stats = open_stats(d->name);
+}
+
+static void sample_dev_stats(struct usbdevice *d)
+{
+	sample_stats(d->stats);
+}
+
+static void print_stats_children(struct usbdevice *d, unsigned long long ms)
+{
+	char vendor[128], product[128];
+
+	indent += 4;
+	while (d) {
+		get_vendor_string(vendor, sizeof(vendor), d->idVendor);
+		get_product_string(product, sizeof(product), d->idVendor, d->idProduct);
+		printf(" %*s", indent, "|__ ");
+		printf("Port %u: Dev %u, ID %04x:%04x %s %s, %sM",
+		       d->portnum, d->devnum, d->idVendor, d->idProduct,
+		       vendor, product, d->speed);
+		print_stats(d->stats, ms);
+		print_stats_children(d->first_child, ms);
+		d = d->next;
+	}
+	indent -= 4;
+}
+
+static unsigned long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Sample urbnum and the runtime PM counters of every device each interval
+ * milliseconds, and show the rates in tree layout.  The attribute files
+ * are opened once, so every tick costs one pread() per counter.
+ */
+int lsusb_stats(unsigned int interval)
+{
+	struct usbbusnode *b;
+	unsigned long long then, now;
+	struct timespec tick;
+
+	if (build_tree())
+		return 1;
+
+	for (b = usbbuslist; b; b = b->next) {
+		b->stats = open_stats(b->name);
+		sample_stats(b->stats);
+		for_each_stats(b->first_child, open_dev_stats);
+		for_each_stats(b->first_child, sample_dev_stats);
+	}
+	then = now_ms();
+
+	for (;;) {
+		/* not usleep(): intervals of an hour and more overflow it */
+		tick.tv_sec = interval / 1000;
+		tick.tv_nsec = (interval % 1000) * 1000000L;
+		while (nanosleep(&tick, &tick) < 0 && errno == EINTR)
+			;
+		for (b = usbbuslist; b; b = b->next) {
+			sample_stats(b->stats);
+			for_each_stats(b->first_child, sample_dev_stats);
+		}
+		now = now_ms();
+		if (now == then)
+			continue;
+
+		if (isatty(STDOUT_FILENO))
+			printf("\033[H\033[2J");
+		else
+			printf("\n");
+		for (b = usbbuslist; b; b = b->next) {
+			printf("/:  Bus %02u.Port %u: Dev %u, %sM", b->busnum, 1,
+			       b->devnum, b->speed);
+			print_stats(b->stats, now - then);
+			print_stats_children(b->first_child, now - then);
+		}
+		fflush(stdout);
+		then = now;
+	}
+	return 0;
+}
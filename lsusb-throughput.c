@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Endpoint throughput table for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "bandwidth.h"
+#include "usbmisc.h"
+
+struct ep_row {
+	uint8_t busnum;
+	uint8_t devnum;
+	uint16_t vendor;
+	uint16_t product;
+	uint8_t ifnum;
+	uint8_t alt;
+	uint8_t epaddr;
+	uint8_t type;
+	unsigned int maxp;
+	unsigned int burst;		/* packets per burst or per interval */
+	unsigned int streams;
+	int speed;
+	unsigned long long bps;
+	unsigned long long link;
+};
+
+static struct ep_row *rows;
+static unsigned int nrows, maxrows;
+
+/* ---------------------------------------------------------------------- */
+
+static void ep_burst(const struct libusb_endpoint_descriptor *ep, int speed,
+		     struct ep_row *r)
+{
+	const unsigned char *buf = ep->extra;
+	int size = ep->extra_length;
+
+	r->burst = 1;
+	r->streams = 0;
+	if (speed == LIBUSB_SPEED_HIGH && (r->type & 1))
+		r->burst = ((ep->wMaxPacketSize >> 11) & 3) + 1;
+	if (speed < LIBUSB_SPEED_SUPER)
+		return;
+
+	while (buf && size >= 2) {
+		if (buf[0] < 2 || buf[0] > size)
+			break;
+		if (buf[1] == USB_DT_SS_ENDPOINT_COMP && buf[0] >= 6) {
+			r->burst = buf[2] + 1;
+			if (r->type == LIBUSB_TRANSFER_TYPE_BULK && (buf[3] & 0x1f))
+				r->streams = 1U << (buf[3] & 0x1f);
+			else if (r->type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+				r->burst *= (buf[3] & 3) + 1;
+			return;
+		}
+		size -= buf[0];
+		buf += buf[0];
+	}
+}
+
+static void add_row(libusb_device *dev, const struct libusb_device_descriptor *desc,
+		    const struct libusb_interface_descriptor *alt,
+		    const struct libusb_endpoint_descriptor *ep, int speed)
+{
+	struct ep_row *r;
+
+	if (nrows == maxrows) {
+		struct ep_row *n;
+
+		maxrows = maxrows ? 2 * maxrows : 64;
+		n = realloc(rows, maxrows * sizeof(*rows));
+		if (!n)
+			return;
+		rows = n;
+	}
+	r = &rows[nrows++];
+	memset(r, 0, sizeof(*r));
+	r->busnum = libusb_get_bus_number(dev);
+	r->devnum = libusb_get_device_address(dev);
+	r->vendor = desc->idVendor;
+	r->product = desc->idProduct;
+	r->ifnum = alt->bInterfaceNumber;
+	r->alt = alt->bAlternateSetting;
+	r->epaddr = ep->bEndpointAddress;
+	r->type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	r->maxp = ep->wMaxPacketSize & 0x7ff;
+	r->speed = speed;
+	r->bps = bw_ep_max_throughput(ep, speed);
+	r->link = bw_link_bytes_per_second(speed);
+	ep_burst(ep, speed, r);
+}
+
+/*
+ * Collect the endpoints of the device's active configuration; the table
+ * is printed once all devices have been seen.
+ */
+int lsusb_throughput(libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+	struct libusb_config_descriptor *config;
+	int speed = libusb_get_device_speed(dev);
+	int i, j, k;
+
+	if (libusb_get_device_descriptor(dev, &desc))
+		return 1;
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return 1;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		for (j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+
+			for (k = 0; k < alt->bNumEndpoints; k++) {
+				const struct libusb_endpoint_descriptor *ep = &alt->endpoint[k];
+				unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+
+				/* interrupt endpoints are not meant to carry bulk data */
+				if (type == LIBUSB_TRANSFER_TYPE_INTERRUPT && !verblevel)
+					continue;
+				add_row(dev, &desc, alt, ep, speed);
+			}
+		}
+	}
+
+	libusb_free_config_descriptor(config);
+	return 0;
+}
+
+/* per mille of the link rate, so that rows sort without floating point */
+static unsigned long long link_share(const struct ep_row *r)
+{
+	return r->link ? r->bps * 1000 / r->link : 0;
+}
+
+static int cmp_rows(const void *a, const void *b)
+{
+	unsigned long long sa = link_share(a), sb = link_share(b);
+
+	if (sa != sb)
+		return sa < sb ? -1 : 1;
+	return 0;
+}
+
+/* print the collected endpoints, the furthest below their link rate first */
+void lsusb_throughput_table(void)
+{
+	static const char * const types[] = { "Ctrl", "Isoc", "Bulk", "Intr" };
+	char rate[32], link[32];
+	unsigned int i;
+
+	if (!nrows)
+		return;
+	qsort(rows, nrows, sizeof(*rows), cmp_rows);
+
+	printf("\n%-7s %-9s %-5s %-4s %-4s %5s %5s %7s  %12s  %12s %6s\n",
+	       "Bus:Dev", "ID", "If.Alt", "EP", "Type", "MaxP", "Burst",
+	       "Streams", "Max", "Link", "Share");
+	for (i = 0; i < nrows; i++) {
+		const struct ep_row *r = &rows[i];
+		unsigned long long share = link_share(r);
+
+		printf("%03u:%03u %04x:%04x %3u.%-2u 0x%02x %-4s %5u %5u %7u  %12s  %12s %3llu.%llu%%\n",
+		       r->busnum, r->devnum, r->vendor, r->product,
+		       r->ifnum, r->alt, r->epaddr, types[r->type], r->maxp,
+		       r->burst, r->streams,
+		       bw_format_rate(rate, sizeof(rate), r->bps),
+		       bw_format_rate(link, sizeof(link), r->link),
+		       share / 10, share % 10);
+	}
+
+	free(rows);
+	rows = NULL;
+	nrows = maxrows = 0;
+}
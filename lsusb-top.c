@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Live per endpoint bus usage for lsusb, from usbmon
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "names.h"
+#include "usbmon.h"
+#include "bandwidth.h"
+
+#define TOP_SLOTS		1024	/* power of 2 */
+#define TOP_DEVICES		256
+#define TOP_INTERVAL_USEC	1000000
+
+struct top_counter {
+	uint32_t key;			/* bus << 16 | devnum << 8 | epnum */
+	uint8_t used;
+	uint8_t xfer_type;
+	uint64_t urbs;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t last_urbs;
+	uint64_t last_bytes;
+};
+
+struct top_device {
+	uint16_t busnum;
+	uint8_t devnum;
+	uint8_t valid;
+	uint16_t vendor;
+	uint16_t product;
+};
+
+struct top {
+	libusb_context *ctx;
+	struct top_counter counters[TOP_SLOTS];
+	unsigned int nused;
+	struct top_device devices[TOP_DEVICES];
+	unsigned int ndevices;
+	int rescan;			/* unknown device seen, ask libusb */
+	uint64_t start;			/* of the current interval */
+	uint64_t last;			/* latest event seen */
+	int live;
+};
+
+/* ---------------------------------------------------------------------- */
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* open addressing; the table never shrinks, so no tombstones needed */
+static struct top_counter *find_counter(struct top *t, uint32_t key)
+{
+	unsigned int i = (key * 2654435761U) & (TOP_SLOTS - 1);
+	unsigned int n;
+
+	for (n = 0; n < TOP_SLOTS; n++, i = (i + 1) & (TOP_SLOTS - 1)) {
+		if (!t->counters[i].used) {
+			if (t->nused == TOP_SLOTS - 1)
+				return NULL;
+			t->counters[i].used = 1;
+			t->counters[i].key = key;
+			t->nused++;
+			return &t->counters[i];
+		}
+		if (t->counters[i].key == key)
+			return &t->counters[i];
+	}
+	return NULL;
+}
+
+static struct top_device *find_device(struct top *t, uint16_t bus, uint8_t dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->ndevices; i++)
+		if (t->devices[i].busnum == bus && t->devices[i].devnum == dev)
+			return &t->devices[i];
+	if (t->ndevices == TOP_DEVICES)
+		return NULL;
+	t->devices[t->ndevices].busnum = bus;
+	t->devices[t->ndevices].devnum = dev;
+	return &t->devices[t->ndevices++];
+}
+
+/* label devices not seen enumerating in the trace from the live bus */
+static void rescan_devices(struct top *t)
+{
+	struct libusb_device_descriptor desc;
+	struct top_device *d;
+	libusb_device **list;
+	ssize_t n, i;
+
+	t->rescan = 0;
+	if (!t->ctx)
+		return;
+	n = libusb_get_device_list(t->ctx, &list);
+	if (n < 0)
+		return;
+	for (i = 0; i < n; i++) {
+		d = find_device(t, libusb_get_bus_number(list[i]),
+				libusb_get_device_address(list[i]));
+		if (!d || d->valid || libusb_get_device_descriptor(list[i], &desc))
+			continue;
+		d->vendor = desc.idVendor;
+		d->product = desc.idProduct;
+		d->valid = 1;
+	}
+	libusb_free_device_list(list, 1);
+}
+
+/* ---------------------------------------------------------------------- */
+
+static char *format_bytes(char *buf, size_t size, unsigned long long bytes)
+{
+	size_t len = strlen(bw_format_rate(buf, size, bytes));
+
+	/* the same units, without the "/s" */
+	if (len > 2)
+		buf[len - 2] = 0;
+	return buf;
+}
+
+static int cmp_counters(const void *a, const void *b)
+{
+	const struct top_counter *ca = *(const struct top_counter * const *)a;
+	const struct top_counter *cb = *(const struct top_counter * const *)b;
+	uint64_t ra = ca->bytes - ca->last_bytes;
+	uint64_t rb = cb->bytes - cb->last_bytes;
+
+	if (ra != rb)
+		return ra < rb ? 1 : -1;
+	if (ca->bytes != cb->bytes)
+		return ca->bytes < cb->bytes ? 1 : -1;
+	return ca->key < cb->key ? -1 : 1;
+}
+
+static void print_top(struct top *t, uint64_t usec)
+{
+	static const char * const types[] = { "Isoc", "Intr", "Ctrl", "Bulk" };
+	struct top_counter *sorted[TOP_SLOTS];
+	char rate[32], total[32];
+	unsigned int i, n = 0;
+
+	if (t->rescan)
+		rescan_devices(t);
+	if (!usec)
+		usec = 1;
+
+	for (i = 0; i < TOP_SLOTS; i++)
+		if (t->counters[i].used)
+			sorted[n++] = &t->counters[i];
+	qsort(sorted, n, sizeof(sorted[0]), cmp_counters);
+
+	if (t->live && isatty(STDOUT_FILENO))
+		printf("\033[H\033[2J");
+	printf("%-7s %-4s %-4s %-3s %8s %12s %12s %6s  %-9s %s\n",
+	       "Bus:Dev", "EP", "Type", "Dir", "URB/s", "Rate", "Total",
+	       "Errors", "ID", "Device");
+	for (i = 0; i < n; i++) {
+		struct top_counter *c = sorted[i];
+		unsigned int bus = c->key >> 16, dev = (c->key >> 8) & 0xff;
+		struct top_device *d = find_device(t, bus, dev);
+		const char *vendor = NULL, *product = NULL;
+
+		printf("%03u:%03u 0x%02x %-4s %-3s %8llu %12s %12s %6llu  ",
+		       bus, dev, c->key & 0xff, types[c->xfer_type & 3],
+		       c->key & 0x80 ? "IN" : "OUT",
+		       (unsigned long long)((c->urbs - c->last_urbs) * 1000000 / usec),
+		       bw_format_rate(rate, sizeof(rate),
+				      (c->bytes - c->last_bytes) * 1000000 / usec),
+		       format_bytes(total, sizeof(total), c->bytes),
+		       (unsigned long long)c->errors);
+		if (d && d->valid) {
+			vendor = names_vendor(d->vendor);
+			product = names_product(d->vendor, d->product);
+			printf("%04x:%04x %s %s\n", d->vendor, d->product,
+			       vendor ? vendor : "", product ? product : "");
+		} else {
+			printf("%-9s\n", "?");
+		}
+		c->last_urbs = c->urbs;
+		c->last_bytes = c->bytes;
+	}
+	fflush(stdout);
+}
+
+static int top_event(const struct usbmon_event *ev, void *data)
+{
+	struct top *t = data;
+	struct top_counter *c;
+	struct top_device *d;
+	uint16_t vendor, product;
+
+	/* trace time drives the refresh when replaying a capture */
+	if (!t->live) {
+		t->last = ev->ts_usec;
+		if (!t->start)
+			t->start = ev->ts_usec;
+		else if (ev->ts_usec - t->start >= TOP_INTERVAL_USEC) {
+			printf("\n");
+			print_top(t, ev->ts_usec - t->start);
+			t->start = ev->ts_usec;
+		}
+	}
+
+	if (!usbmon_device_ids(ev, &vendor, &product)) {
+		d = find_device(t, ev->busnum, ev->devnum);
+		if (d) {
+			d->vendor = vendor;
+			d->product = product;
+			d->valid = 1;
+		}
+	}
+
+	/* completions carry the length actually transferred */
+	if (ev->type == 'S')
+		return 0;
+	c = find_counter(t, ev->busnum << 16 | ev->devnum << 8 | ev->epnum);
+	if (!c)
+		return 0;
+	c->xfer_type = ev->xfer_type;
+	c->urbs++;
+	c->bytes += ev->length;
+	if (ev->type == 'E' || ev->status < 0)
+		c->errors++;
+
+	d = find_device(t, ev->busnum, ev->devnum);
+	if (d && !d->valid)
+		t->rescan = 1;
+	return 0;
+}
+
+/*
+ * Show which devices and endpoints move how much data, refreshed every
+ * second.  Reads /dev/usbmon0 live, or replays a pcap capture when one
+ * is given.
+ */
+int lsusb_top(libusb_context *ctx, const char *capture)
+{
+	struct top *t;
+	struct usbmon *mon;
+	uint64_t now, last;
+	int ret = 0;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return 1;
+	t->ctx = ctx;
+
+	if (capture) {
+		if (usbmon_read_pcap(capture, top_event, t))
+			ret = 1;
+		else if (t->start) {
+			printf("\n");
+			print_top(t, t->last - t->start);
+		}
+		free(t);
+		return ret;
+	}
+
+	mon = usbmon_open(0);
+	if (!mon) {
+		free(t);
+		return 1;
+	}
+	t->live = 1;
+	rescan_devices(t);
+	last = now_usec();
+	for (;;) {
+		now = now_usec();
+		if (now - last >= TOP_INTERVAL_USEC) {
+			print_top(t, now - last);
+			last = now;
+		}
+		if (usbmon_poll(mon, (TOP_INTERVAL_USEC - (now - last)) / 1000 + 1,
+				top_event, t) < 0) {
+			perror("usbmon");
+			ret = 1;
+			break;
+		}
+	}
+	usbmon_close(mon);
+	free(t);
+	return ret;
+}
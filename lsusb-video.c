@@ -0,0 +1,494 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * UVC streaming mode reports for lsusb
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+#include "bandwidth.h"
+
+#define USB_CLASS_VIDEO			0x0e
+#define USB_DT_CS_INTERFACE		0x24
+
+/* VideoStreaming interface descriptor subtypes */
+#define UVC_VS_FORMAT_UNCOMPRESSED	0x04
+#define UVC_VS_FRAME_UNCOMPRESSED	0x05
+#define UVC_VS_FORMAT_MJPEG		0x06
+#define UVC_VS_FRAME_MJPEG		0x07
+#define UVC_VS_FORMAT_FRAME_BASED	0x10
+#define UVC_VS_FRAME_FRAME_BASED	0x11
+
+/* VideoStreaming requests and controls */
+#define UVC_SET_CUR			0x01
+#define UVC_GET_CUR			0x81
+#define UVC_GET_MAX			0x83
+#define UVC_VS_PROBE_CONTROL		0x01
+
+/* UVC 1.5 probe control; older devices return a shorter one */
+#define UVC_PROBE_MAX			48
+#define UVC_PROBE_MIN			26
+
+/* worst case UVC payload header, sent once per (micro)frame transfer */
+#define UVC_PAYLOAD_HEADER_MAX		12
+
+#define MAX_ALTSETTINGS			32
+
+struct vs_alt {
+	unsigned int alt;
+	unsigned int epaddr;
+	unsigned int bytes;		/* per service interval */
+	unsigned int interval;		/* in bus intervals */
+	unsigned long long bps;		/* 0 for bulk */
+	int bulk;
+};
+
+struct vs_format {
+	unsigned int index;
+	unsigned int bpp;
+	int compressed;
+	char name[9];		/* FourCC, or the GUID's first 4 bytes in hex */
+};
+
+/* ---------------------------------------------------------------------- */
+
+static void format_name(struct vs_format *f, const unsigned char *guid)
+{
+	int i;
+
+	/* UVC format GUIDs carry a FourCC in their first four bytes */
+	for (i = 0; i < 4; i++) {
+		if (!isprint(guid[i]))
+			break;
+		f->name[i] = guid[i];
+	}
+	if (i < 4)
+		snprintf(f->name, sizeof(f->name), "%02x%02x%02x%02x",
+			 guid[3], guid[2], guid[1], guid[0]);
+	else
+		f->name[4] = '\0';
+}
+
+static unsigned int get_vs_alts(const struct libusb_interface *intf, int speed,
+				struct vs_alt *alts)
+{
+	unsigned int n = 0;
+	int i, j;
+
+	for (i = 0; i < intf->num_altsetting && n < MAX_ALTSETTINGS; i++) {
+		const struct libusb_interface_descriptor *as = &intf->altsetting[i];
+
+		for (j = 0; j < as->bNumEndpoints; j++) {
+			const struct libusb_endpoint_descriptor *ep = &as->endpoint[j];
+			unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+
+			if (type != LIBUSB_TRANSFER_TYPE_ISOCHRONOUS &&
+			    type != LIBUSB_TRANSFER_TYPE_BULK)
+				continue;
+			alts[n].alt = as->bAlternateSetting;
+			alts[n].epaddr = ep->bEndpointAddress;
+			alts[n].bytes = bw_ep_bytes_per_interval(ep, speed);
+			alts[n].interval = bw_ep_interval(ep, speed);
+			alts[n].bps = bw_ep_bytes_per_second(ep, speed);
+			alts[n].bulk = type == LIBUSB_TRANSFER_TYPE_BULK;
+			n++;
+			break;
+		}
+	}
+	return n;
+}
+
+/*
+ * Find the isochronous alternate setting with the least reserved bandwidth
+ * which still carries bps bytes per second.
+ */
+static const struct vs_alt *match_alt(const struct vs_alt *alts, unsigned int nalts,
+				      unsigned long long bps)
+{
+	const struct vs_alt *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < nalts; i++) {
+		if (alts[i].bulk || alts[i].bps < bps)
+			continue;
+		if (!best || alts[i].bps < best->bps)
+			best = &alts[i];
+	}
+	return best;
+}
+
+static void print_mode(const struct vs_format *f, const unsigned char *buf,
+		       unsigned int interval, int speed,
+		       const struct vs_alt *alts, unsigned int nalts)
+{
+	unsigned int width = convert_le_u16(buf + 5);
+	unsigned int height = convert_le_u16(buf + 7);
+	unsigned int ips = bw_intervals_per_second(speed);
+	unsigned long long frame, bps, need;
+	const struct vs_alt *alt;
+	unsigned int i;
+
+	printf("    %-8s %3u %3u %5u x %-5u %9u %7.2f ",
+	       f->name, f->index, buf[3], width, height, interval,
+	       interval ? 10000000.0 / interval : 0.0);
+
+	if (f->compressed || !interval) {
+		printf("%14s  %s\n", "-", "compressed");
+		return;
+	}
+
+	frame = (unsigned long long)width * height * f->bpp / 8;
+	bps = frame * 10000000ULL / interval;
+	need = (bps + ips - 1) / ips + UVC_PAYLOAD_HEADER_MAX;
+	printf("%14llu  ", need);
+
+	alt = match_alt(alts, nalts, need * ips);
+	if (alt) {
+		printf("alt %u (%u bytes/%u)\n", alt->alt, alt->bytes, alt->interval);
+		return;
+	}
+	for (i = 0; i < nalts; i++)
+		if (alts[i].bulk) {
+			printf("bulk EP 0x%02x\n", alts[i].epaddr);
+			return;
+		}
+	printf("does not fit\n");
+}
+
+static void print_frame_modes(const struct vs_format *f, const unsigned char *buf,
+			      int speed, const struct vs_alt *alts, unsigned int nalts)
+{
+	unsigned int n, i, count, min, max, step;
+
+	/* frame based frames lack dwMaxVideoFrameBufferSize */
+	n = buf[2] == UVC_VS_FRAME_FRAME_BASED ? 21 : 25;
+	if (buf[0] < n + 1)
+		return;
+	count = buf[n];
+	if (count) {
+		for (i = 0; i < count && 26 + 4 * i + 4 <= buf[0]; i++)
+			print_mode(f, buf, convert_le_u32(buf + 26 + 4 * i), speed, alts, nalts);
+		return;
+	}
+	if (buf[0] < 38)
+		return;
+	/* continuous intervals: the extremes bound the bandwidth */
+	min = convert_le_u32(buf + 26);
+	max = convert_le_u32(buf + 30);
+	step = convert_le_u32(buf + 34);
+	print_mode(f, buf, min, speed, alts, nalts);
+	if (max != min && step)
+		print_mode(f, buf, max, speed, alts, nalts);
+}
+
+typedef void (*vs_frame_fn)(const struct vs_format *f, const unsigned char *buf,
+			   void *data);
+
+/*
+ * Call fn for every frame descriptor of an uncompressed, MJPEG or frame
+ * based format in the class-specific descriptors of alt setting 0.
+ */
+static void walk_vs_frames(const struct libusb_interface_descriptor *as0,
+			   vs_frame_fn fn, void *data)
+{
+	struct vs_format fmt;
+	const unsigned char *buf = as0->extra;
+	int size = as0->extra_length;
+
+	memset(&fmt, 0, sizeof(fmt));
+	while (buf && size >= 3) {
+		if (buf[0] < 3 || buf[0] > size)
+			break;
+		if (buf[1] != USB_DT_CS_INTERFACE)
+			goto next;
+
+		switch (buf[2]) {
+		case UVC_VS_FORMAT_UNCOMPRESSED:
+		case UVC_VS_FORMAT_FRAME_BASED:
+			if (buf[0] < 27)
+				break;
+			fmt.index = buf[3];
+			fmt.bpp = buf[21];
+			fmt.compressed = buf[2] == UVC_VS_FORMAT_FRAME_BASED;
+			format_name(&fmt, buf + 5);
+			break;
+		case UVC_VS_FORMAT_MJPEG:
+			if (buf[0] < 11)
+				break;
+			fmt.index = buf[3];
+			fmt.bpp = 0;
+			fmt.compressed = 1;
+			strcpy(fmt.name, "MJPEG");
+			break;
+		case UVC_VS_FRAME_UNCOMPRESSED:
+		case UVC_VS_FRAME_MJPEG:
+		case UVC_VS_FRAME_FRAME_BASED:
+			if (fmt.index && buf[0] >= 26)
+				fn(&fmt, buf, data);
+			break;
+		}
+next:
+		size -= buf[0];
+		buf += buf[0];
+	}
+}
+
+struct vs_modes {
+	int speed;
+	const struct vs_alt *alts;
+	unsigned int nalts;
+};
+
+static void mode_frame(const struct vs_format *f, const unsigned char *buf, void *data)
+{
+	struct vs_modes *m = data;
+
+	print_frame_modes(f, buf, m->speed, m->alts, m->nalts);
+}
+
+static void print_vs_header(const struct libusb_interface_descriptor *as0, int speed,
+			    const struct vs_alt *alts, unsigned int nalts)
+{
+	unsigned int i;
+
+	printf("  VideoStreaming Interface %u (%s, %u bus intervals/s):\n",
+	       as0->bInterfaceNumber, bw_speed_name(speed),
+	       bw_intervals_per_second(speed));
+	for (i = 0; i < nalts; i++)
+		printf("    Alt %2u  EP 0x%02x  %s %5u bytes every %u interval(s)\n",
+		       alts[i].alt, alts[i].epaddr,
+		       alts[i].bulk ? "bulk" : "isoc",
+		       alts[i].bytes, alts[i].interval);
+}
+
+static void do_vs_interface(const struct libusb_interface *intf, int speed)
+{
+	struct vs_alt alts[MAX_ALTSETTINGS];
+	struct vs_modes m;
+
+	m.speed = speed;
+	m.alts = alts;
+	m.nalts = get_vs_alts(intf, speed, alts);
+
+	print_vs_header(&intf->altsetting[0], speed, alts, m.nalts);
+	printf("    %-8s %3s %3s %13s %9s %7s %14s  %s\n",
+	       "Format", "Fmt", "Frm", "Resolution", "Interval", "fps",
+	       "Bytes/interval", "AltSetting");
+	walk_vs_frames(&intf->altsetting[0], mode_frame, &m);
+}
+
+/* ---------------------------------------------------------------------- */
+
+struct vs_probe {
+	libusb_device_handle *udev;
+	unsigned int ifnum;
+	const struct vs_alt *alts;
+	unsigned int nalts;
+	unsigned char cur[UVC_PROBE_MAX];
+	int len;
+};
+
+static int probe_ctrl(libusb_device_handle *udev, uint8_t request,
+		      unsigned int ifnum, unsigned char *buf, int len)
+{
+	uint8_t type = LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE;
+
+	if (request & 0x80)
+		type |= LIBUSB_ENDPOINT_IN;
+	return libusb_control_transfer(udev, type, request,
+				       UVC_VS_PROBE_CONTROL << 8, ifnum,
+				       buf, len, CTRL_TIMEOUT);
+}
+
+/* the alt setting the Linux uvcvideo driver would pick for this payload */
+static const struct vs_alt *payload_alt(const struct vs_alt *alts, unsigned int nalts,
+					unsigned int payload)
+{
+	const struct vs_alt *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < nalts; i++) {
+		if (alts[i].bulk || alts[i].bytes < payload)
+			continue;
+		if (!best || alts[i].bytes < best->bytes)
+			best = &alts[i];
+	}
+	return best;
+}
+
+static void probe_frame(const struct vs_format *f, const unsigned char *buf, void *data)
+{
+	struct vs_probe *p = data;
+	unsigned char probe[UVC_PROBE_MAX];
+	unsigned int interval, bufsize, payload;
+	const struct vs_alt *alt;
+	int ret;
+
+	if (buf[2] == UVC_VS_FRAME_FRAME_BASED) {
+		interval = convert_le_u32(buf + 17);
+		bufsize = 0;
+	} else {
+		interval = convert_le_u32(buf + 21);
+		bufsize = convert_le_u32(buf + 17);
+	}
+
+	printf("    %-8s %3u %3u %5u x %-5u %9u ",
+	       f->name, f->index, buf[3], convert_le_u16(buf + 5), convert_le_u16(buf + 7),
+	       interval);
+	if (bufsize)
+		printf("%10u ", bufsize);
+	else
+		printf("%10s ", "-");
+
+	/* start from the device's own state, only asking for this mode */
+	memcpy(probe, p->cur, p->len);
+	probe[0] = 0x01;	/* bmHint: keep dwFrameInterval */
+	probe[1] = 0x00;
+	probe[2] = f->index;
+	probe[3] = buf[3];
+	probe[4] = interval & 0xff;
+	probe[5] = (interval >> 8) & 0xff;
+	probe[6] = (interval >> 16) & 0xff;
+	probe[7] = (interval >> 24) & 0xff;
+	memset(probe + 18, 0, 8);
+
+	ret = probe_ctrl(p->udev, UVC_SET_CUR, p->ifnum, probe, p->len);
+	if (ret >= 0)
+		ret = probe_ctrl(p->udev, UVC_GET_CUR, p->ifnum, probe, p->len);
+	if (ret < UVC_PROBE_MIN) {
+		printf("probe failed (%s)\n",
+		       ret < 0 ? libusb_error_name(ret) : "short reply");
+		return;
+	}
+
+	payload = convert_le_u32(probe + 22);
+	printf("%10u %10u  ", convert_le_u32(probe + 18), payload);
+	if (probe[2] != f->index || probe[3] != buf[3])
+		printf("(device chose %u/%u) ", probe[2], probe[3]);
+	alt = payload_alt(p->alts, p->nalts, payload);
+	if (alt)
+		printf("alt %u\n", alt->alt);
+	else if (p->nalts && p->alts[0].bulk)
+		printf("bulk\n");
+	else
+		printf("does not fit\n");
+}
+
+static void probe_vs_interface(libusb_device_handle *udev,
+			       const struct libusb_interface *intf, int speed)
+{
+	struct vs_alt alts[MAX_ALTSETTINGS];
+	unsigned char max[UVC_PROBE_MAX];
+	struct vs_probe p;
+	int ret;
+
+	memset(&p, 0, sizeof(p));
+	p.udev = udev;
+	p.ifnum = intf->altsetting[0].bInterfaceNumber;
+	p.alts = alts;
+	p.nalts = get_vs_alts(intf, speed, alts);
+
+	print_vs_header(&intf->altsetting[0], speed, alts, p.nalts);
+
+	/* recent Linuxes require claim() for RECIP_INTERFACE; a bound
+	 * uvcvideo driver keeps the interface to itself.
+	 */
+	if (libusb_claim_interface(udev, p.ifnum)) {
+		printf("    Probe Control:\n"
+		       "      ** UNAVAILABLE **\n");
+		return;
+	}
+
+	p.len = probe_ctrl(udev, UVC_GET_CUR, p.ifnum, p.cur, sizeof(p.cur));
+	if (p.len < UVC_PROBE_MIN) {
+		printf("    Probe Control GET_CUR failed (%s)\n",
+		       p.len < 0 ? libusb_error_name(p.len) : "short reply");
+		goto out;
+	}
+
+	ret = probe_ctrl(udev, UVC_GET_MAX, p.ifnum, max, p.len);
+	if (ret >= UVC_PROBE_MIN)
+		printf("    Probe Control GET_MAX: dwMaxVideoFrameSize %u"
+		       "  dwMaxPayloadTransferSize %u\n",
+		       convert_le_u32(max + 18), convert_le_u32(max + 22));
+
+	printf("    %-8s %3s %3s %13s %9s %10s %10s %10s  %s\n",
+	       "Format", "Fmt", "Frm", "Resolution", "Interval",
+	       "BufferSize", "FrameSize", "Payload", "AltSetting");
+	walk_vs_frames(&intf->altsetting[0], probe_frame, &p);
+
+	/* put back what we found; nothing is ever committed */
+	probe_ctrl(udev, UVC_SET_CUR, p.ifnum, p.cur, p.len);
+out:
+	libusb_release_interface(udev, p.ifnum);
+}
+
+/*
+ * Negotiate every frame of every format through VS_PROBE_CONTROL and show
+ * the payload sizes the device asks for.  VS_COMMIT_CONTROL is never sent,
+ * so no stream is started and no bandwidth is reserved.
+ */
+int lsusb_video_probe(libusb_device *dev)
+{
+	struct libusb_config_descriptor *config;
+	libusb_device_handle *udev;
+	int speed = libusb_get_device_speed(dev);
+	int i;
+
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return 1;
+
+	udev = NULL;
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		if (intf->num_altsetting < 1)
+			continue;
+		if (intf->altsetting[0].bInterfaceClass != USB_CLASS_VIDEO ||
+		    intf->altsetting[0].bInterfaceSubClass != 2)
+			continue;
+		if (!udev && libusb_open(dev, &udev)) {
+			fprintf(stderr, "Couldn't open device, probe "
+				"information will be missing\n");
+			udev = NULL;
+			break;
+		}
+		probe_vs_interface(udev, intf, speed);
+	}
+
+	if (udev)
+		libusb_close(udev);
+	libusb_free_config_descriptor(config);
+	return 0;
+}
+
+int lsusb_video_modes(libusb_device *dev)
+{
+	struct libusb_config_descriptor *config;
+	int speed = libusb_get_device_speed(dev);
+	int i;
+
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return 1;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		if (intf->num_altsetting < 1)
+			continue;
+		if (intf->altsetting[0].bInterfaceClass != USB_CLASS_VIDEO ||
+		    intf->altsetting[0].bInterfaceSubClass != 2)
+			continue;
+		do_vs_interface(intf, speed);
+	}
+
+	libusb_free_config_descriptor(config);
+	return 0;
+}
@@ -0,0 +1,467 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * xHCI endpoint context report for lsusb
+ *
+ * The xhci_hcd debugfs files hold the slot and endpoint contexts the
+ * driver handed to the controller, decoded by xhci_decode_slot_context()
+ * and xhci_decode_ep_context():
+ *
+ *   <root>/<controller>/devices/<slot>/slot-context
+ *   <root>/<controller>/devices/<slot>/ep-context	one line per endpoint
+ *   <root>/<controller>/reg-ext-protocol:NN		port ranges per USB major
+ *
+ * Devices are matched to slots by root port and route string.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include <libusb.h>
+
+#include "lsusb.h"
+#include "usbmisc.h"
+#include "bandwidth.h"
+
+#define XHCI_MAX_EPS		32	/* device context indexes */
+#define XHCI_MAX_PORTS		256
+
+static const char sys_bus_usb_devices[] = "/sys/bus/usb/devices";
+
+struct xhci_slot {
+	unsigned int id;
+	unsigned int route;
+	unsigned int port;		/* xHC root hub port, 1 based */
+	int usb3;
+	char state[32];
+};
+
+struct xhci_ep {
+	int valid;
+	char state[16];
+	char type[16];
+	unsigned int mult;
+	unsigned int streams;
+	unsigned int interval_us;
+	unsigned int esit;
+	unsigned int burst;		/* additional packets, as in the context */
+	unsigned int maxp;
+	unsigned long long deq;
+};
+
+/* ---------------------------------------------------------------------- */
+
+static int read_line(const char *path, char *buf, size_t size)
+{
+	FILE *f = fopen(path, "r");
+	char *nl;
+
+	if (!f)
+		return -1;
+	if (!fgets(buf, size, f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	nl = strchr(buf, '\n');
+	if (nl)
+		*nl = 0;
+	return 0;
+}
+
+/* the number following key in s */
+static int field(const char *s, const char *key, unsigned int *val, int base)
+{
+	const char *p = strstr(s, key);
+	char *end;
+
+	if (!p)
+		return -1;
+	p += strlen(key);
+	*val = strtoul(p, &end, base);
+	return end == p ? -1 : 0;
+}
+
+/* the word following key in s */
+static void field_word(const char *s, const char *key, char *buf, size_t size)
+{
+	const char *p = strstr(s, key);
+	size_t n = 0;
+
+	buf[0] = 0;
+	if (!p)
+		return;
+	p += strlen(key);
+	while (p[n] && !isspace((unsigned char)p[n]))
+		n++;
+	if (n >= size)
+		n = size - 1;
+	memcpy(buf, p, n);
+	buf[n] = 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ * xHC port numbers of the USB 2 (usb3 == 0) or USB 3 root hub, in root
+ * hub port order, from the supported protocol capabilities.
+ */
+static unsigned int protocol_ports(const char *ctrl, int usb3,
+				   unsigned int *ports, unsigned int max)
+{
+	char path[PATH_MAX + 64], line[128];
+	unsigned int n = 0, rev = 0, info = 0, i, j, t;
+	struct dirent *de;
+	FILE *f;
+	DIR *d;
+
+	d = opendir(ctrl);
+	if (!d)
+		return 0;
+	while ((de = readdir(d))) {
+		if (strncmp(de->d_name, "reg-ext-protocol", 16))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", ctrl, de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		rev = info = 0;
+		while (fgets(line, sizeof(line), f)) {
+			field(line, "EXTCAP_REVISION = ", &rev, 16);
+			field(line, "EXTCAP_PORTINFO = ", &info, 16);
+		}
+		fclose(f);
+		if ((rev >> 24 >= 3) != !!usb3)
+			continue;
+		for (i = 0; i < ((info >> 8) & 0xff) && n < max; i++)
+			ports[n++] = (info & 0xff) + i;
+	}
+	closedir(d);
+
+	/* several capabilities of one major are numbered in port order */
+	for (i = 1; i < n; i++)
+		for (j = i; j > 0 && ports[j - 1] > ports[j]; j--) {
+			t = ports[j];
+			ports[j] = ports[j - 1];
+			ports[j - 1] = t;
+		}
+	return n;
+}
+
+static int read_slot(const char *dir, struct xhci_slot *s)
+{
+	char path[PATH_MAX + 32], line[256];
+	unsigned int num;
+
+	snprintf(path, sizeof(path), "%s/slot-context", dir);
+	if (read_line(path, line, sizeof(line)))
+		return -1;
+	if (field(line, "RS ", &s->route, 16) ||
+	    field(line, "Port# ", &s->port, 10))
+		return -1;
+	s->usb3 = strstr(line, "super-speed") != NULL;
+	if (!field(line, "Ctx Entries ", &num, 10) && !num)
+		return -1;
+	field_word(line, "State ", s->state, sizeof(s->state));
+	return 0;
+}
+
+static void read_eps(const char *dir, struct xhci_ep *eps)
+{
+	char path[PATH_MAX + 32], line[512];
+	unsigned int dci = 0;
+	const char *p, *t, *end;
+	FILE *f;
+
+	memset(eps, 0, XHCI_MAX_EPS * sizeof(*eps));
+	snprintf(path, sizeof(path), "%s/ep-context", dir);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	/* one line per endpoint context, DCI 1 (EP0) first */
+	while (fgets(line, sizeof(line), f) && ++dci < XHCI_MAX_EPS) {
+		struct xhci_ep *e = &eps[dci];
+
+		p = strstr(line, ": ");
+		if (!p)
+			continue;
+		field_word(p, "State ", e->state, sizeof(e->state));
+		if (!strcmp(e->state, "disabled") || !e->state[0])
+			continue;
+		e->valid = 1;
+		field(p, "mult ", &e->mult, 10);
+		field(p, "max P. Streams ", &e->streams, 10);
+		field(p, "interval ", &e->interval_us, 10);
+		field(p, "max ESIT payload ", &e->esit, 10);
+		field(p, "burst ", &e->burst, 10);	/* "Max Burst" */
+		field(p, "maxp ", &e->maxp, 10);
+		t = strstr(p, "deq ");
+		if (t)
+			e->deq = strtoull(t + 4, NULL, 16);
+		/* "Type Bulk IN burst", "Type Int IN HIDburst" */
+		t = strstr(p, "Type ");
+		end = t ? strstr(t, "burst ") : NULL;
+		if (end) {
+			t += 5;
+			while (end > t && (isspace((unsigned char)end[-1]) ||
+					   (end - t >= 3 && !strncmp(end - 3, "HID", 3))))
+				end -= isspace((unsigned char)end[-1]) ? 1 : 3;
+			snprintf(e->type, sizeof(e->type), "%.*s", (int)(end - t), t);
+		}
+	}
+	fclose(f);
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* sysfs name of the controller the device's bus hangs off */
+static int controller_name(libusb_device *dev, char *buf, size_t size)
+{
+	char link[64], path[PATH_MAX], *p;
+
+	snprintf(link, sizeof(link), "%s/usb%d", sys_bus_usb_devices,
+		 libusb_get_bus_number(dev));
+	if (!realpath(link, path))
+		return -1;
+	p = strrchr(path, '/');
+	if (!p)
+		return -1;
+	*p = 0;
+	p = strrchr(path, '/');
+	snprintf(buf, size, "%s", p ? p + 1 : path);
+	return 0;
+}
+
+/*
+ * The controller's directory in root.  In an offline copy, which may come
+ * from another machine, a single directory is taken as is; in the live
+ * debugfs the name must match, or a device on an EHCI bus would be joined
+ * with the slots of an unrelated xHCI.
+ */
+static int controller_dir(const char *root, const char *name, int offline,
+			  char *buf, size_t size)
+{
+	struct dirent *de;
+	int n = 0;
+	DIR *d;
+
+	if (name[0]) {
+		snprintf(buf, size, "%s/%s/devices", root, name);
+		d = opendir(buf);
+		if (d) {
+			closedir(d);
+			snprintf(buf, size, "%s/%s", root, name);
+			return 0;
+		}
+	}
+	if (!offline)
+		return -1;
+	d = opendir(root);
+	if (!d)
+		return -1;
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(buf, size, "%s/%s", root, de->d_name);
+		n++;
+	}
+	closedir(d);
+	return n == 1 ? 0 : -1;
+}
+
+static int find_slot(const char *ctrl, libusb_device *dev, struct xhci_slot *slot,
+		     char *slotdir, size_t size)
+{
+	uint8_t path[8];
+	unsigned int ports[XHCI_MAX_PORTS], nports, route = 0, xhc_port = 0;
+	int depth, usb3, i, found = 0;
+	char dir[PATH_MAX + 16];
+	struct xhci_slot s;
+	struct dirent *de;
+	DIR *d;
+
+	depth = libusb_get_port_numbers(dev, path, sizeof(path));
+	if (depth < 1)
+		return -1;
+	for (i = 1; i < depth; i++)
+		route |= (path[i] > 15 ? 15 : path[i]) << (4 * (i - 1));
+	usb3 = libusb_get_device_speed(dev) >= LIBUSB_SPEED_SUPER;
+	nports = protocol_ports(ctrl, usb3, ports, XHCI_MAX_PORTS);
+	if (path[0] <= nports)
+		xhc_port = ports[path[0] - 1];
+
+	snprintf(dir, sizeof(dir), "%s/devices", ctrl);
+	d = opendir(dir);
+	if (!d)
+		return -1;
+	while ((de = readdir(d))) {
+		if (!isdigit((unsigned char)de->d_name[0]))
+			continue;
+		snprintf(dir, sizeof(dir), "%s/devices/%s", ctrl, de->d_name);
+		memset(&s, 0, sizeof(s));
+		if (read_slot(dir, &s) || s.route != route || s.usb3 != usb3)
+			continue;
+		/* without port ranges, trust the route string if it is unique */
+		if (xhc_port && s.port != xhc_port)
+			continue;
+		s.id = strtoul(de->d_name, NULL, 10);
+		*slot = s;
+		snprintf(slotdir, size, "%s", dir);
+		found++;
+	}
+	closedir(d);
+	return found == 1 ? 0 : -1;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* the service interval the descriptor asks for, in microseconds */
+static unsigned int requested_us(const struct libusb_endpoint_descriptor *ep, int speed)
+{
+	unsigned int n = bw_ep_interval(ep, speed);
+
+	return speed >= LIBUSB_SPEED_HIGH ? n * 125 : n * 1000;
+}
+
+/* packets per burst and bursts per interval the descriptor asks for */
+static void requested_burst(const struct libusb_endpoint_descriptor *ep, int speed,
+			    unsigned int *burst, unsigned int *mult)
+{
+	const unsigned char *comp;
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+
+	*burst = 0;
+	*mult = 1;
+	if (speed >= LIBUSB_SPEED_SUPER) {
+		comp = bw_ss_ep_comp(ep);
+		if (comp) {
+			*burst = comp[2];
+			if (type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS && !(comp[3] & 0x80))
+				*mult = (comp[3] & 3) + 1;
+		}
+	} else if (speed == LIBUSB_SPEED_HIGH &&
+		   (type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS ||
+		    type == LIBUSB_TRANSFER_TYPE_INTERRUPT)) {
+		/* xHCI puts high bandwidth transactions into Max Burst */
+		*burst = (ep->wMaxPacketSize >> 11) & 3;
+	}
+}
+
+static void print_ep(const struct libusb_endpoint_descriptor *ep,
+		     const struct xhci_ep *e, int speed)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	int periodic = type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS ||
+		       type == LIBUSB_TRANSFER_TYPE_INTERRUPT;
+	unsigned int interval = requested_us(ep, speed);
+	unsigned int maxp = ep->wMaxPacketSize & 0x7ff;
+	unsigned int esit = bw_ep_bytes_per_interval(ep, speed);
+	unsigned int burst, mult;
+	char i1[16] = "-", i2[16] = "-";
+
+	requested_burst(ep, speed, &burst, &mult);
+	if (periodic) {
+		snprintf(i1, sizeof(i1), "%u", interval);
+		snprintf(i2, sizeof(i2), "%u", e->interval_us);
+	}
+	printf("    0x%02x %-9s %-8s %7s/%-7s %5u/%-5u %3u/%-3u %2u/%-2u",
+	       ep->bEndpointAddress, e->type, e->state, i1, i2,
+	       maxp, e->maxp, burst + 1, e->burst + 1, mult, e->mult);
+	if (periodic)
+		printf(" %6u/%-6u", esit, e->esit);
+	if (verblevel)
+		printf(" deq %#llx", e->deq);
+	printf("\n");
+
+	if (periodic && e->interval_us > interval)
+		printf("      ** polled every %u us, the descriptor asks for %u us **\n",
+		       e->interval_us, interval);
+	if (e->maxp != maxp)
+		printf("      ** max packet %u programmed, %u in the descriptor **\n",
+		       e->maxp, maxp);
+	if (e->burst != burst)
+		printf("      ** burst of %u programmed, %u in the descriptor **\n",
+		       e->burst + 1, burst + 1);
+	if (periodic && e->mult != mult)
+		printf("      ** mult %u programmed, %u in the descriptor **\n",
+		       e->mult, mult);
+	if (periodic && e->esit < esit)
+		printf("      ** %u bytes per interval reserved, the descriptor needs %u **\n",
+		       e->esit, esit);
+	if (!strcmp(e->state, "halted") || !strcmp(e->state, "error"))
+		printf("      ** endpoint %s **\n", e->state);
+}
+
+/*
+ * Show how xhci_hcd programmed the controller for each endpoint of the
+ * active alt settings, next to what the descriptors ask for.  root is the
+ * xhci debugfs directory, or a copy of it.
+ */
+int lsusb_xhci(libusb_device *dev, const char *root)
+{
+	struct libusb_config_descriptor *config;
+	struct xhci_ep eps[XHCI_MAX_EPS];
+	struct xhci_slot slot;
+	char name[64], ctrl[PATH_MAX], slotdir[PATH_MAX + 16], iface[96];
+	int speed = libusb_get_device_speed(dev);
+	int i, j, k, alt, offline = root != NULL;
+
+	if (!libusb_get_parent(dev))
+		return 0;	/* root hubs have no slot */
+	if (!root)
+		root = "/sys/kernel/debug/usb/xhci";
+	if (controller_name(dev, name, sizeof(name)))
+		name[0] = 0;
+	if (controller_dir(root, name, offline, ctrl, sizeof(ctrl)))
+		return 1;	/* not an xHCI, or no debugfs */
+	if (find_slot(ctrl, dev, &slot, slotdir, sizeof(slotdir))) {
+		printf("xHCI: no slot context found in %s\n", ctrl);
+		return 1;
+	}
+	read_eps(slotdir, eps);
+
+	printf("xHCI slot %u, root port %u, route %05x, %s\n",
+	       slot.id, slot.port, slot.route, slot.state);
+	printf("    EP   Type      State      Interval us      MaxP     Burst   Mult   Bytes/interval\n"
+	       "                              (descriptor/xHCI)\n");
+
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return 1;
+	if (get_sysfs_name(name, sizeof(name), dev))
+		name[0] = 0;
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		if (intf->num_altsetting < 1)
+			continue;
+		snprintf(iface, sizeof(iface), "%s:%d.%d", name,
+			 config->bConfigurationValue,
+			 intf->altsetting[0].bInterfaceNumber);
+		alt = name[0] ? read_sysfs_attr_int(iface, "bAlternateSetting") : -1;
+		for (j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *as = &intf->altsetting[j];
+
+			if (alt >= 0 ? as->bAlternateSetting != alt : j)
+				continue;
+			for (k = 0; k < as->bNumEndpoints; k++) {
+				const struct libusb_endpoint_descriptor *ep = &as->endpoint[k];
+				unsigned int dci = (ep->bEndpointAddress & 0x0f) * 2 +
+					!!(ep->bEndpointAddress & LIBUSB_ENDPOINT_IN);
+
+				if (dci >= XHCI_MAX_EPS || !eps[dci].valid) {
+					printf("    0x%02x not enabled in the controller\n",
+					       ep->bEndpointAddress);
+					continue;
+				}
+				print_ep(ep, &eps[dci], speed);
+			}
+		}
+	}
+	libusb_free_config_descriptor(config);
+	return 0;
+}
@@ -26,10 +26,13 @@
 #include <unistd.h>
 
 #include "lsusb.h"
+#include "liblsusb-private.h"
 #include "names.h"
 #include "usbmisc.h"
 #include "desc-defs.h"
 #include "desc-dump.h"
+#include "bandwidth.h"
+#include "sched.h"
 
 #include <getopt.h>
 
@@ -50,7 +53,7 @@
 #define USB_DT_WIRE_ADAPTER		0x21
 #define USB_DT_RPIPE			0x22
 #define USB_DT_RC_INTERFACE		0x23
-#define USB_DT_SS_ENDPOINT_COMP		0x30
+#define USB_DT_SSP_ISOC_EP_COMP		0x31
 
 /* Device Capability Type Codes (Wireless USB spec and USB 3.0 bus spec) */
 #define USB_DC_WIRELESS_USB		0x01
@@ -105,7 +108,8 @@
 #define VERBLEVEL_DEFAULT 0	/* 0 gives lspci behaviour; 1, lsusb-0.9 */
 
 #define CTRL_RETRIES	 2
-#define CTRL_TIMEOUT	(5*1000)	/* milliseconds */
+
+#define MAX_INTERVAL_SECS	(24*60*60)	/* --stats and --timeout */
 
 #define	HUB_STATUS_BYTELEN	3	/* max 3 bytes status = hub + 23 ports */
 
@@ -118,6 +122,30 @@
 
 unsigned int verblevel = VERBLEVEL_DEFAULT;
 static int do_report_desc = 1;
+static int do_video_modes;
+static int do_video_probe;
+static int do_audio_modes;
+static int do_audio_clocks;
+static int do_ntb;
+static int do_uas_audit;
+static int do_power_audit;
+static int do_xhci;
+static const char *xhci_root;
+static int do_throughput;
+static int do_schedule;
+static int do_irq;
+static int do_top;
+static const char *top_capture;
+static const char *analyze_capture;
+static unsigned int stats_interval;
+static int do_monitor;
+static int do_hotplug_profile;
+static int do_wait;
+static const char *wait_serial;
+static int wait_timeout = -1;
+
+/* link speed of the device being dumped, LIBUSB_SPEED_* */
+static int link_speed;
 static const char * const encryption_type[] = {
 	"UNSECURE",
 	"WIRED",
@@ -164,18 +192,6 @@ static void dump_billboard_alt_mode_capability_desc(libusb_device_handle *dev, u
 
 /* ---------------------------------------------------------------------- */
 
-static unsigned int convert_le_u32 (const unsigned char *buf)
-{
-	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
-}
-
-static unsigned int convert_le_u16 (const unsigned char *buf)
-{
-	return buf[0] | (buf[1] << 8);
-}
-
-/* ---------------------------------------------------------------------- */
-
 /* workaround libusb API goofs:  "byte" should never be sign extended;
  * using "char" is trouble.
  */
@@ -793,6 +809,16 @@ static void dump_endpoint(libusb_device_handle *dev, const struct libusb_interfa
 					printf("        Mult %20u\n",
 							buf[3] & 0x3);
 				break;
+			case USB_DT_SSP_ISOC_EP_COMP:
+				if (buf[0] < 8) {
+					printf("        SuperSpeedPlus Isochronous Endpoint Companion: ");
+					dump_bytes(buf, buf[0]);
+					break;
+				}
+				printf("        dwBytesPerInterval %6u\n",
+				       buf[4] | (buf[5] << 8) | (buf[6] << 16) |
+				       ((unsigned) buf[7] << 24));
+				break;
 			default:
 				/* often a misplaced class descriptor */
 				printf("        ** UNRECOGNIZED: ");
@@ -803,6 +829,14 @@ static void dump_endpoint(libusb_device_handle *dev, const struct libusb_interfa
 			buf += buf[0];
 		}
 	}
+
+	if (link_speed != LIBUSB_SPEED_UNKNOWN) {
+		char rate[32];
+
+		printf("        Max Throughput %12s\n",
+		       bw_format_rate(rate, sizeof(rate),
+				      bw_ep_max_throughput(endpoint, link_speed)));
+	}
 }
 
 static void dump_unit(unsigned int data, unsigned int len)
@@ -1031,14 +1065,20 @@ static void dump_audiocontrol_interface(libusb_device_handle *dev, const unsigne
 
 	case UAC_INTERFACE_SUBTYPE_CLOCK_SOURCE:
 		dump_audio_subtype(dev, "CLOCK_SOURCE", desc_audio_ac_clock_source, buf, protocol, 4);
+		if (do_audio_clocks)
+			audio_clock_dump(buf[3], 4);
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_CLOCK_SELECTOR:
 		dump_audio_subtype(dev, "CLOCK_SELECTOR", desc_audio_ac_clock_selector, buf, protocol, 4);
+		if (do_audio_clocks)
+			audio_clock_dump(buf[3], 4);
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_CLOCK_MULTIPLIER:
 		dump_audio_subtype(dev, "CLOCK_MULTIPLIER", desc_audio_ac_clock_multiplier, buf, protocol, 4);
+		if (do_audio_clocks)
+			audio_clock_dump(buf[3], 4);
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_SAMPLE_RATE_CONVERTER:
@@ -2916,6 +2956,165 @@ static void do_hub(libusb_device_handle *fd, unsigned tt_type, unsigned speed)
 	}
 }
 
+/*
+ * Periodic bytes one frame must carry at full speed for an interface,
+ * taking its most demanding alt setting.
+ */
+static unsigned int fs_frame_bytes(const struct libusb_interface *intf,
+				   const struct sched *fs)
+{
+	unsigned int max = 0, sum;
+	struct sched_ep e;
+	int i, j;
+
+	for (i = 0; i < intf->num_altsetting; i++) {
+		const struct libusb_interface_descriptor *alt = &intf->altsetting[i];
+
+		sum = 0;
+		for (j = 0; j < alt->bNumEndpoints; j++)
+			if (!sched_ep_init(&e, &alt->endpoint[j], fs, LIBUSB_SPEED_FULL, -1))
+				sum += e.cost;
+		if (sum > max)
+			max = sum;
+	}
+	return max;
+}
+
+static const struct libusb_endpoint_descriptor *
+find_endpoint(const struct libusb_config_descriptor *config,
+	      const struct libusb_interface_descriptor *alt, uint8_t addr)
+{
+	int i, j, k;
+
+	for (i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		for (j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *a = &intf->altsetting[j];
+
+			if (a->bInterfaceNumber != alt->bInterfaceNumber ||
+			    a->bAlternateSetting != alt->bAlternateSetting)
+				continue;
+			for (k = 0; k < a->bNumEndpoints; k++)
+				if (a->endpoint[k].bEndpointAddress == addr)
+					return &a->endpoint[k];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Compare the high speed configuration with the full speed one the device
+ * falls back to on a USB 1.1 port or below a full speed hub: throughput
+ * of every endpoint, and the periodic bandwidth the full speed frame (or
+ * a single TT) would have to carry.
+ */
+static void dump_fs_fallback(const struct libusb_config_descriptor *hs,
+			     const struct libusb_config_descriptor *fs)
+{
+	static const char * const types[] = { "Control", "Isoc", "Bulk", "Interrupt" };
+	char hsrate[32], fsrate[32];
+	unsigned int frame = 0, bytes;
+	struct sched s;
+	int i, j, k;
+
+	sched_init(&s, LIBUSB_SPEED_FULL);
+	printf("  Full Speed Fallback (configuration %u):\n"
+	       "    If Alt EP    Type       %12s %12s\n",
+	       fs->bConfigurationValue, "High Speed", "Full Speed");
+	for (i = 0; i < fs->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &fs->interface[i];
+
+		for (j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+
+			for (k = 0; k < alt->bNumEndpoints; k++) {
+				const struct libusb_endpoint_descriptor *ep = &alt->endpoint[k];
+				const struct libusb_endpoint_descriptor *hsep;
+
+				hsep = find_endpoint(hs, alt, ep->bEndpointAddress);
+				if (hsep)
+					bw_format_rate(hsrate, sizeof(hsrate),
+						bw_ep_max_throughput(hsep, LIBUSB_SPEED_HIGH));
+				else
+					strcpy(hsrate, "-");
+				printf("    %2u %3u 0x%02x %-10s %12s %12s\n",
+				       alt->bInterfaceNumber, alt->bAlternateSetting,
+				       ep->bEndpointAddress, types[ep->bmAttributes & 3],
+				       hsrate, bw_format_rate(fsrate, sizeof(fsrate),
+					       bw_ep_max_throughput(ep, LIBUSB_SPEED_FULL)));
+			}
+		}
+		frame += fs_frame_bytes(intf, &s);
+	}
+
+	bytes = s.budget;
+	printf("    Periodic bytes per frame, largest alt settings: %u of %u (%u%%)%s\n",
+	       frame, bytes, frame * 100 / bytes,
+	       frame > bytes ? ", does not fit a full speed bus" :
+	       frame > s.tt_budget ? ", does not fit a single TT" : "");
+}
+
+static void do_other_speed(libusb_device_handle *fd, unsigned int nconfigs)
+{
+	libusb_device *dev = libusb_get_device(fd);
+	struct libusb_config_descriptor *other, *config;
+	int speed = link_speed;
+	unsigned char *buf;
+	unsigned int i;
+	int len, ret;
+
+	/* what this device's endpoints would do at the other speed */
+	link_speed = speed == LIBUSB_SPEED_HIGH ? LIBUSB_SPEED_FULL :
+		     speed == LIBUSB_SPEED_FULL ? LIBUSB_SPEED_HIGH :
+		     LIBUSB_SPEED_UNKNOWN;
+
+	for (i = 0; i < nconfigs; i++) {
+		unsigned char head[LIBUSB_DT_CONFIG_SIZE];
+
+		ret = usb_control_msg(fd,
+				LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD | LIBUSB_RECIPIENT_DEVICE,
+				LIBUSB_REQUEST_GET_DESCRIPTOR,
+				(USB_DT_OTHER_SPEED_CONFIG << 8) | i, 0,
+				head, sizeof head, CTRL_TIMEOUT);
+		if (ret != sizeof head || head[1] != USB_DT_OTHER_SPEED_CONFIG) {
+			if (ret < 0 && errno != EPIPE)
+				perror("can't get other speed configuration");
+			break;
+		}
+		len = head[2] | (head[3] << 8);
+		buf = malloc(len);
+		if (!buf)
+			break;
+		ret = usb_control_msg(fd,
+				LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD | LIBUSB_RECIPIENT_DEVICE,
+				LIBUSB_REQUEST_GET_DESCRIPTOR,
+				(USB_DT_OTHER_SPEED_CONFIG << 8) | i, 0,
+				buf, len, CTRL_TIMEOUT);
+		if (ret < LIBUSB_DT_CONFIG_SIZE ||
+		    parse_config_descriptor(buf, ret, &other)) {
+			free(buf);
+			break;
+		}
+		free(buf);
+
+		printf("Other Speed Configuration (for other device speed):\n");
+		dump_config(fd, other, 0x0200);
+
+		/* predict the full speed fallback of a high speed device */
+		if (!libusb_get_config_descriptor(dev, i, &config)) {
+			if (speed == LIBUSB_SPEED_HIGH)
+				dump_fs_fallback(config, other);
+			else if (speed == LIBUSB_SPEED_FULL)
+				dump_fs_fallback(other, config);
+			libusb_free_config_descriptor(config);
+		}
+		free_config_descriptor(other);
+	}
+
+	link_speed = speed;
+}
+
 static void do_dualspeed(libusb_device_handle *fd)
 {
 	unsigned char buf[10];
@@ -2958,7 +3157,7 @@ static void do_dualspeed(libusb_device_handle *fd)
 	       buf[6], proto,
 	       buf[7], buf[8]);
 
-	/* FIXME also show the OTHER_SPEED_CONFIG descriptors */
+	do_other_speed(fd, buf[8]);
 }
 
 static void do_debug(libusb_device_handle *fd)
@@ -3622,6 +3821,7 @@ static void dumpdev(libusb_device *dev)
 	int otg, wireless;
 
 	otg = wireless = 0;
+	link_speed = libusb_get_device_speed(dev);
 	ret = libusb_open(dev, &udev);
 	if (ret) {
 		fprintf(stderr, "Couldn't open device, some information "
@@ -3652,6 +3852,8 @@ static void dumpdev(libusb_device *dev)
 						"descriptor %d, some information will "
 						"be missing\n", i);
 			} else {
+				if (do_audio_clocks && udev)
+					audio_clock_query(udev, config);
 				dump_config(udev, config, desc.bcdUSB);
 				libusb_free_config_descriptor(config);
 			}
@@ -3679,6 +3881,27 @@ static void dumpdev(libusb_device *dev)
 
 /* ---------------------------------------------------------------------- */
 
+/* per device reports selected by long options */
+static void dump_reports(libusb_device *dev)
+{
+	if (do_video_modes)
+		lsusb_video_modes(dev);
+	if (do_video_probe)
+		lsusb_video_probe(dev);
+	if (do_audio_modes)
+		lsusb_audio_modes(dev);
+	if (do_ntb)
+		lsusb_ntb(dev);
+	if (do_uas_audit)
+		lsusb_uas_audit(dev);
+	if (do_power_audit)
+		lsusb_power_audit(dev);
+	if (do_xhci)
+		lsusb_xhci(dev, xhci_root);
+	if (do_throughput)
+		lsusb_throughput(dev);
+}
+
 static int dump_one_device(libusb_context *ctx, const char *path)
 {
 	libusb_device *dev;
@@ -3698,61 +3921,40 @@ static int dump_one_device(libusb_context *ctx, const char *path)
 					       vendor,
 					       product);
 	dumpdev(dev);
+	dump_reports(dev);
 	return 0;
 }
 
-static int list_devices(libusb_context *ctx, int busnum, int devnum, int vendorid, int productid)
+/* the device records come from liblsusb, in libusb's order */
+static int list_devices(libusb_context *ctx, const struct usb_match *match)
 {
-	libusb_device **list;
-	struct libusb_device_descriptor desc;
-	char vendor[128], product[128];
+	struct liblsusb_device **list, *d;
 	int status;
-	ssize_t num_devs, i, vendor_len, product_len;
+	ssize_t num_devs, i;
 
 	status = 1; /* 1 device not found, 0 device found */
 
-	num_devs = libusb_get_device_list(ctx, &list);
+	num_devs = get_device_records(ctx, match, &list);
 	if (num_devs < 0)
 		goto error;
 
 	for (i = 0; i < num_devs; ++i) {
-		libusb_device *dev = list[i];
-		uint8_t bnum = libusb_get_bus_number(dev);
-		uint8_t dnum = libusb_get_device_address(dev);
-		uint8_t pnum = libusb_get_port_number(dev);
-
-		if ((busnum != -1 && busnum != bnum) ||
-		    (devnum != -1 && devnum != dnum))
-			continue;
-		libusb_get_device_descriptor(dev, &desc);
-		if ((vendorid != -1 && vendorid != desc.idVendor) ||
-		    (productid != -1 && productid != desc.idProduct))
-			continue;
+		d = list[i];
 		status = 0;
 
-		vendor_len = get_vendor_string(vendor, sizeof(vendor), desc.idVendor);
-		if (vendor_len == 0)
-			read_sysfs_prop(vendor, sizeof(vendor), bnum, pnum,
-					"manufacturer");
-
-		product_len = get_product_string(product, sizeof(product),
-				desc.idVendor, desc.idProduct);
-		if (product_len == 0)
-			read_sysfs_prop(product, sizeof(product), bnum, pnum,
-					"product");
-
 		if (verblevel > 0)
 			printf("\n");
 		printf("Bus %03u Device %03u: ID %04x:%04x %s %s\n",
-				bnum, dnum,
-				desc.idVendor,
-				desc.idProduct,
-				vendor, product);
+				d->busnum, d->devnum,
+				d->desc.idVendor,
+				d->desc.idProduct,
+				d->vendor, d->product);
 		if (verblevel > 0)
-			dumpdev(dev);
+			dumpdev(d->usb);
+		dump_reports(d->usb);
 	}
 
-	libusb_free_device_list(list, 0);
+	liblsusb_free_devices(list);
 error:
 	return status;
 }
@@ -3760,6 +3962,43 @@ error:
 
 /* ---------------------------------------------------------------------- */
 
+/* long options without a short equivalent */
+enum {
+	OPT_VIDEO_MODES = 0x100,
+	OPT_VIDEO_PROBE,
+	OPT_AUDIO_MODES,
+	OPT_AUDIO_CLOCKS,
+	OPT_NTB,
+	OPT_UAS_AUDIT,
+	OPT_THROUGHPUT,
+	OPT_SCHEDULE,
+	OPT_TOP,
+	OPT_ANALYZE,
+	OPT_STATS,
+	OPT_POWER_AUDIT,
+	OPT_IRQ,
+	OPT_XHCI,
+	OPT_MONITOR,
+	OPT_HOTPLUG_PROFILE,
+	OPT_WAIT,
+	OPT_TIMEOUT,
+};
+
+/* "vendor:[product]" in hex, as -d and --wait take it */
+static int parse_vidpid(char *arg, int *vendor, int *product)
+{
+	char *cp = strchr(arg, ':');
+
+	if (!cp)
+		return -1;
+	*cp++ = 0;
+	if (*arg)
+		*vendor = strtoul(arg, NULL, 16);
+	if (*cp)
+		*product = strtoul(cp, NULL, 16);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	static const struct option long_options[] = {
@@ -3767,6 +4006,24 @@ int main(int argc, char *argv[])
 		{ "verbose", 0, 0, 'v' },
 		{ "help", 0, 0, 'h' },
 		{ "tree", 0, 0, 't' },
+		{ "video-modes", 0, 0, OPT_VIDEO_MODES },
+		{ "video-probe", 0, 0, OPT_VIDEO_PROBE },
+		{ "audio-modes", 0, 0, OPT_AUDIO_MODES },
+		{ "audio-clocks", 0, 0, OPT_AUDIO_CLOCKS },
+		{ "ntb", 0, 0, OPT_NTB },
+		{ "uas-audit", 0, 0, OPT_UAS_AUDIT },
+		{ "throughput", 0, 0, OPT_THROUGHPUT },
+		{ "schedule", 0, 0, OPT_SCHEDULE },
+		{ "top", 2, 0, OPT_TOP },
+		{ "analyze", 1, 0, OPT_ANALYZE },
+		{ "stats", 1, 0, OPT_STATS },
+		{ "power-audit", 0, 0, OPT_POWER_AUDIT },
+		{ "irq", 0, 0, OPT_IRQ },
+		{ "xhci", 2, 0, OPT_XHCI },
+		{ "monitor", 0, 0, OPT_MONITOR },
+		{ "hotplug-profile", 0, 0, OPT_HOTPLUG_PROFILE },
+		{ "wait", 1, 0, OPT_WAIT },
+		{ "timeout", 1, 0, OPT_TIMEOUT },
 		{ 0, 0, 0, 0 }
 	};
 	libusb_context *ctx;
@@ -3775,6 +4032,7 @@ int main(int argc, char *argv[])
 	int bus = -1, devnum = -1, vendor = -1, product = -1;
 	const char *devdump = NULL;
 	int help = 0;
+	double secs;
 	char *cp;
 	int status;
 
@@ -3813,28 +4071,126 @@ int main(int argc, char *argv[])
 			break;
 
 		case 'd':
-			cp = strchr(optarg, ':');
-			if (!cp) {
+			if (parse_vidpid(optarg, &vendor, &product))
 				err++;
-				break;
-			}
-			*cp++ = 0;
-			if (*optarg)
-				vendor = strtoul(optarg, NULL, 16);
-			if (*cp)
-				product = strtoul(cp, NULL, 16);
 			break;
 
 		case 'D':
 			devdump = optarg;
 			break;
 
+		case OPT_VIDEO_MODES:
+			do_video_modes = 1;
+			break;
+
+		case OPT_VIDEO_PROBE:
+			do_video_probe = 1;
+			break;
+
+		case OPT_AUDIO_MODES:
+			do_audio_modes = 1;
+			break;
+
+		case OPT_AUDIO_CLOCKS:
+			do_audio_clocks = 1;
+			break;
+
+		case OPT_NTB:
+			do_ntb = 1;
+			break;
+
+		case OPT_UAS_AUDIT:
+			do_uas_audit = 1;
+			break;
+
+		case OPT_THROUGHPUT:
+			do_throughput = 1;
+			break;
+
+		case OPT_SCHEDULE:
+			do_schedule = 1;
+			break;
+
+		case OPT_TOP:
+			do_top = 1;
+			top_capture = optarg;
+			break;
+
+		case OPT_ANALYZE:
+			analyze_capture = optarg;
+			break;
+
+		case OPT_STATS:
+			secs = strtod(optarg, &cp);
+			if (cp == optarg || *cp || !(secs > 0) || secs > MAX_INTERVAL_SECS)
+				err++;
+			else if (!(stats_interval = secs * 1000))
+				err++;
+			break;
+
+		case OPT_POWER_AUDIT:
+			do_power_audit = 1;
+			break;
+
+		case OPT_IRQ:
+			do_irq = 1;
+			break;
+
+		case OPT_XHCI:
+			do_xhci = 1;
+			xhci_root = optarg;
+			break;
+
+		case OPT_MONITOR:
+			do_monitor = 1;
+			break;
+
+		case OPT_HOTPLUG_PROFILE:
+			do_hotplug_profile = 1;
+			break;
+
+		case OPT_WAIT:
+			do_wait = 1;
+			cp = strchr(optarg, ',');
+			if (cp) {
+				*cp++ = 0;
+				wait_serial = cp;
+			}
+			if (parse_vidpid(optarg, &vendor, &product))
+				err++;
+			break;
+
+		case OPT_TIMEOUT:
+			secs = strtod(optarg, &cp);
+			if (cp == optarg || *cp || !(secs >= 0) || secs > MAX_INTERVAL_SECS)
+				err++;
+			else
+				wait_timeout = secs * 1000;
+			break;
+
 		case '?':
 		default:
 			err++;
 			break;
 		}
 	}
+	if (!err && !help) {
+		/* each of these replaces the device list, so only one at a time */
+		int modes = !!treemode + !!devdump + do_top + !!analyze_capture +
+			    !!stats_interval + do_schedule + do_irq + do_monitor +
+			    do_hotplug_profile + do_wait;
+
+		if (modes > 1) {
+			fprintf(stderr, "lsusb: only one of -t, -D, --top, --analyze, --stats, "
+				"--schedule, --irq, --monitor, --hotplug-profile and --wait "
+				"can be given\n");
+			return EXIT_FAILURE;
+		}
+		if (wait_timeout >= 0 && !do_wait) {
+			fprintf(stderr, "lsusb: --timeout needs --wait\n");
+			return EXIT_FAILURE;
+		}
+	}
 	if (err || argc > optind || help) {
 		fprintf(stderr, "Usage: lsusb [options]...\n"
 			"List USB devices\n"
@@ -3850,6 +4206,40 @@ int main(int argc, char *argv[])
 			"      Selects which device lsusb will examine\n"
 			"  -t, --tree\n"
 			"      Dump the physical USB device hierarchy as a tree\n"
+			"  --video-modes\n"
+			"      Show which UVC modes fit which streaming alt setting\n"
+			"  --video-probe\n"
+			"      Negotiate each UVC mode (probe only) and show payload sizes\n"
+			"  --audio-modes\n"
+			"      Check UAC alt setting/rate combinations against wMaxPacketSize\n"
+			"  --audio-clocks\n"
+			"      With -v, read UAC2/UAC3 clock frequencies and ranges\n"
+			"  --ntb\n"
+			"      Show CDC NCM/MBIM NTB parameters and the host driver's NTB sizes\n"
+			"  --uas-audit\n"
+			"      Flag UAS capable storage interfaces bound to usb-storage\n"
+			"  --throughput\n"
+			"      Table of endpoint maximum throughput, sorted by share of link rate\n"
+			"  --schedule\n"
+			"      Simulate each bus's periodic schedule and alt setting changes\n"
+			"  --top[=capture.pcap]\n"
+			"      Live per endpoint URB and byte rates from usbmon, or from a capture\n"
+			"  --analyze capture.pcap\n"
+			"      Per endpoint throughput, URB size and latency from a usbmon capture\n"
+			"  --stats interval\n"
+			"      Tree of URB/s and runtime PM activity, sampled every interval seconds\n"
+			"  --power-audit\n"
+			"      Check autosuspend and LPM settings against the device's BOS\n"
+			"  --irq\n"
+			"      Show each bus's controller, NUMA node and interrupt placement\n"
+			"  --xhci[=debugfs-copy]\n"
+			"      Compare xHCI endpoint contexts with the endpoint descriptors\n"
+			"  --monitor\n"
+			"      Watch hotplug events, report flapping ports and enumeration storms\n"
+			"  --hotplug-profile\n"
+			"      Histograms of plug to driver bind and device node latencies\n"
+			"  --wait vendor:[product][,serial] [--timeout seconds]\n"
+			"      Wait for a matching device to be present and print its device node\n"
 			"  -V, --version\n"
 			"      Show version of program\n"
 			"  -h, --help\n"
@@ -3865,6 +4255,18 @@ int main(int argc, char *argv[])
 
 	status = 0;
 
+	if (stats_interval) {
+		status = lsusb_stats(stats_interval);
+		names_exit();
+		return status;
+	}
+
+	if (do_monitor || do_hotplug_profile) {
+		status = do_monitor ? lsusb_monitor() : lsusb_hotplug_profile();
+		names_exit();
+		return status;
+	}
+
 	if (treemode) {
 		status = lsusb_t();
 		names_exit();
@@ -3877,10 +4279,26 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	if (devdump)
+	if (analyze_capture)
+		status = lsusb_analyze(ctx, analyze_capture);
+	else if (do_top)
+		status = lsusb_top(ctx, top_capture);
+	else if (do_schedule)
+		status = lsusb_schedule(ctx, bus);
+	else if (do_irq)
+		status = lsusb_irq(ctx, bus);
+	else if (devdump)
 		status = dump_one_device(ctx, devdump);
-	else
-		status = list_devices(ctx, bus, devnum, vendor, product);
+	else {
+		struct usb_match match = { bus, devnum, vendor, product, wait_serial };
+
+		if (do_wait)
+			status = lsusb_wait(ctx, &match, wait_timeout);
+		else
+			status = list_devices(ctx, &match);
+	}
+	if (do_throughput)
+		lsusb_throughput_table();
 
 	names_exit();
 	libusb_exit(ctx);
@@ -3,7 +3,34 @@
 #ifndef _LSUSB_H
 #define _LSUSB_H
 
+struct libusb_context;
+struct libusb_device;
+struct libusb_device_handle;
+struct libusb_config_descriptor;
+struct usb_match;
+
 extern int lsusb_t(void);
+extern int lsusb_t_context(char *buf, size_t size, const char *name);
+extern int lsusb_monitor(void);
+extern int lsusb_hotplug_profile(void);
+extern int lsusb_wait(struct libusb_context *ctx, const struct usb_match *match, int timeout);
+extern int lsusb_stats(unsigned int interval);
+extern int lsusb_video_modes(struct libusb_device *dev);
+extern int lsusb_video_probe(struct libusb_device *dev);
+extern int lsusb_audio_modes(struct libusb_device *dev);
+extern int lsusb_ntb(struct libusb_device *dev);
+extern int lsusb_uas_audit(struct libusb_device *dev);
+extern int lsusb_power_audit(struct libusb_device *dev);
+extern int lsusb_xhci(struct libusb_device *dev, const char *root);
+extern int lsusb_throughput(struct libusb_device *dev);
+extern void lsusb_throughput_table(void);
+extern int lsusb_schedule(struct libusb_context *ctx, int busnum);
+extern int lsusb_irq(struct libusb_context *ctx, int busnum);
+extern int lsusb_top(struct libusb_context *ctx, const char *capture);
+extern int lsusb_analyze(struct libusb_context *ctx, const char *capture);
+extern int audio_clock_query(struct libusb_device_handle *udev,
+			     const struct libusb_config_descriptor *config);
+extern void audio_clock_dump(unsigned int id, unsigned int indent);
 extern unsigned int verblevel;
 
 #endif
@@ -445,6 +445,12 @@ int names_init(void)
 	return r;
 }
 
+/* the udev context names_init() opened, for users of udev beyond the hwdb */
+struct udev *names_udev(void)
+{
+	return udev;
+}
+
 void names_exit(void)
 {
 	hwdb = udev_hwdb_unref(hwdb);
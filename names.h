@@ -10,6 +10,8 @@
 
 /* ---------------------------------------------------------------------- */
 
+struct udev;
+
 extern const char *names_vendor(uint16_t vendorid);
 extern const char *names_product(uint16_t vendorid, uint16_t productid);
 extern const char *names_class(uint8_t classid);
@@ -35,6 +37,7 @@ extern int get_subclass_string(char *buf, size_t size, uint8_t cls, uint8_t subc
 extern int read_sysfs_prop(char *buf, size_t size, uint8_t bnum, uint8_t pnum, char *propname);
 
 extern int names_init(void);
+extern struct udev *names_udev(void);
 extern void names_exit(void);
 
 /* ---------------------------------------------------------------------- */
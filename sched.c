@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * USB periodic schedule simulator
+ *
+ * Periodic endpoints are placed one at a time into a 32 frame schedule,
+ * split into 8 microframes on high speed and faster buses, the way the
+ * host controller drivers do it: every endpoint gets a fixed phase within
+ * its period and occupies the same slot of every period.  Full and low
+ * speed endpoints below a transaction translator (or an xHCI root port)
+ * are accounted in frames of that TT instead.  Split transaction tokens
+ * are not charged to the high speed microframes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "bandwidth.h"
+#include "sched.h"
+
+/*
+ * Periodic budgets: 80% of a high speed microframe, 90% of a full speed
+ * frame or SuperSpeed bus interval, and the best case full speed budget of
+ * a transaction translator (USB 2.0 section 11.18.1).
+ */
+#define SCHED_HS_BUDGET			6000
+#define SCHED_FS_BUDGET			1350
+#define SCHED_TT_BUDGET			1157
+#define SCHED_SS_BUDGET			56250
+#define SCHED_SSP_BUDGET		136363
+
+/* protocol overhead per transaction in bytes at the endpoint's speed */
+#define SCHED_HS_ISOC_OVERHEAD		38
+#define SCHED_HS_INTR_OVERHEAD		55
+#define SCHED_FS_ISOC_OVERHEAD		9
+#define SCHED_FS_INTR_OVERHEAD		13
+#define SCHED_SS_PACKET_OVERHEAD	28
+
+/* ---------------------------------------------------------------------- */
+
+void sched_init(struct sched *s, int bus_speed)
+{
+	memset(s, 0, sizeof(*s));
+	s->speed = bus_speed;
+	s->tt_budget = SCHED_TT_BUDGET;
+	switch (bus_speed) {
+	case LIBUSB_SPEED_LOW:
+	case LIBUSB_SPEED_FULL:
+		s->nslots = SCHED_FRAMES;
+		s->budget = SCHED_FS_BUDGET;
+		break;
+	case LIBUSB_SPEED_SUPER:
+		s->nslots = SCHED_SLOTS;
+		s->budget = SCHED_SS_BUDGET;
+		break;
+	case LIBUSB_SPEED_SUPER_PLUS:
+		s->nslots = SCHED_SLOTS;
+		s->budget = SCHED_SSP_BUDGET;
+		break;
+	default:
+		s->nslots = SCHED_SLOTS;
+		s->budget = SCHED_HS_BUDGET;
+		break;
+	}
+}
+
+/* bytes a full or low speed endpoint takes from a frame, in full speed time */
+static unsigned int fs_cost(unsigned int bytes, int isoc, int dev_speed)
+{
+	unsigned int cost = bytes * 7 / 6;	/* worst case bit stuffing */
+
+	cost += isoc ? SCHED_FS_ISOC_OVERHEAD : SCHED_FS_INTR_OVERHEAD;
+	if (dev_speed == LIBUSB_SPEED_LOW)
+		cost *= 8;
+	return cost;
+}
+
+static unsigned int clamp_period(unsigned int period, unsigned int nslots)
+{
+	unsigned int p = 1;
+
+	/* hosts round full speed interrupt intervals down to a power of 2 */
+	while (p * 2 <= period && p * 2 <= nslots)
+		p *= 2;
+	return p;
+}
+
+/*
+ * Fill in period and cost of a periodic endpoint of a device running at
+ * dev_speed.  Full and low speed endpoints on a high speed bus must name
+ * their TT.  Returns -1 for bulk and control endpoints.
+ */
+int sched_ep_init(struct sched_ep *e, const struct libusb_endpoint_descriptor *ep,
+		  const struct sched *s, int dev_speed, int tt)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	unsigned int bytes = bw_ep_bytes_per_interval(ep, dev_speed);
+	unsigned int maxp = ep->wMaxPacketSize & 0x7ff;
+	int isoc = type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS;
+	unsigned int trans;
+
+	if (type == LIBUSB_TRANSFER_TYPE_CONTROL ||
+	    type == LIBUSB_TRANSFER_TYPE_BULK)
+		return -1;
+
+	memset(e, 0, sizeof(*e));
+	e->tt = -1;
+	if (dev_speed < LIBUSB_SPEED_HIGH) {
+		e->period = clamp_period(bw_ep_interval(ep, dev_speed), SCHED_FRAMES);
+		e->cost = fs_cost(bytes, isoc, dev_speed);
+		if (s->nslots == SCHED_SLOTS)
+			e->tt = tt;
+		return 0;
+	}
+
+	e->period = clamp_period(bw_ep_interval(ep, dev_speed), SCHED_SLOTS);
+	if (dev_speed == LIBUSB_SPEED_HIGH) {
+		trans = ((ep->wMaxPacketSize >> 11) & 3) + 1;
+		e->cost = bytes * 7 / 6 + trans *
+			(isoc ? SCHED_HS_ISOC_OVERHEAD : SCHED_HS_INTR_OVERHEAD);
+	} else {
+		trans = maxp ? (bytes + maxp - 1) / maxp : 1;
+		e->cost = bytes + trans * SCHED_SS_PACKET_OVERHEAD;
+	}
+	return 0;
+}
+
+static unsigned int *ring_of(struct sched *s, const struct sched_ep *e,
+			     unsigned int *nslots, unsigned int *budget)
+{
+	if (e->tt >= 0 && e->tt < SCHED_MAX_TTS) {
+		*nslots = SCHED_FRAMES;
+		*budget = s->tt_budget;
+		return s->tt_load[e->tt];
+	}
+	*nslots = s->nslots;
+	*budget = s->budget;
+	return s->load;
+}
+
+/*
+ * Place an endpoint at the phase that leaves the lowest peak load, the
+ * earliest one on a tie.  Returns -1 if no phase stays within budget.
+ */
+int sched_add(struct sched *s, struct sched_ep *e)
+{
+	unsigned int nslots, budget, period, phase, slot, peak;
+	unsigned int best = 0, best_peak = ~0U;
+	unsigned int *ring = ring_of(s, e, &nslots, &budget);
+
+	period = e->period < nslots ? e->period : nslots;
+	if (!period)
+		period = 1;
+	for (phase = 0; phase < period; phase++) {
+		peak = 0;
+		for (slot = phase; slot < nslots; slot += period)
+			if (ring[slot] + e->cost > peak)
+				peak = ring[slot] + e->cost;
+		if (peak < best_peak) {
+			best_peak = peak;
+			best = phase;
+		}
+	}
+	if (best_peak > budget)
+		return -1;
+
+	e->period = period;
+	e->phase = best;
+	for (slot = best; slot < nslots; slot += period)
+		ring[slot] += e->cost;
+	return 0;
+}
+
+void sched_remove(struct sched *s, const struct sched_ep *e)
+{
+	unsigned int nslots, budget, slot;
+	unsigned int *ring = ring_of(s, e, &nslots, &budget);
+
+	for (slot = e->phase; slot < nslots; slot += e->period)
+		ring[slot] -= e->cost < ring[slot] ? e->cost : ring[slot];
+}
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * USB periodic schedule simulator
+ */
+
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include <libusb.h>
+
+/* ---------------------------------------------------------------------- */
+
+#define SCHED_FRAMES		32
+#define SCHED_UFRAMES		8
+#define SCHED_SLOTS		(SCHED_FRAMES * SCHED_UFRAMES)
+#define SCHED_MAX_TTS		32
+
+/*
+ * One periodic endpoint as the host schedules it.  Its period and phase
+ * count slots of the schedule it lives in: microframes of the bus
+ * schedule of a high speed or faster bus, frames of a full speed bus or
+ * of a transaction translator.
+ */
+struct sched_ep {
+	unsigned int period;
+	unsigned int cost;		/* bytes per slot, overhead included */
+	int tt;				/* index into sched.tt_load, -1 if none */
+	unsigned int phase;		/* set by sched_add() */
+};
+
+struct sched {
+	int speed;			/* of the bus, LIBUSB_SPEED_* */
+	unsigned int nslots;		/* SCHED_SLOTS, or SCHED_FRAMES at full speed */
+	unsigned int budget;		/* periodic bytes per slot */
+	unsigned int tt_budget;		/* periodic bytes per TT frame */
+	unsigned int load[SCHED_SLOTS];
+	unsigned int tt_load[SCHED_MAX_TTS][SCHED_FRAMES];
+};
+
+extern void sched_init(struct sched *s, int bus_speed);
+extern int sched_ep_init(struct sched_ep *e, const struct libusb_endpoint_descriptor *ep,
+			 const struct sched *s, int dev_speed, int tt);
+extern int sched_add(struct sched *s, struct sched_ep *e);
+extern void sched_remove(struct sched *s, const struct sched_ep *e);
+
+/* ---------------------------------------------------------------------- */
+#endif /* _SCHED_H */
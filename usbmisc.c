@@ -14,6 +14,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <dirent.h>
 
 #ifdef HAVE_ICONV
 #include <iconv.h>
@@ -28,6 +29,7 @@
 /* ---------------------------------------------------------------------- */
 
 static const char *devbususb = "/dev/bus/usb";
+static const char *sysbususb = "/sys/bus/usb/devices";
 
 /* ---------------------------------------------------------------------- */
 
@@ -228,3 +230,282 @@ char *get_dev_string(libusb_device_handle *dev, uint8_t id)
 	return get_dev_string_ascii(dev, 127, id);
 #endif
 }
+
+/*
+ * Read a text attribute of /sys/bus/usb/devices/<name> without its
+ * trailing newline.  Returns 0 on success.
+ */
+int read_sysfs_attr(char *buf, size_t size, const char *name, const char *attr)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	size_t len;
+
+	snprintf(path, sizeof(path), "%s/%s/%s", sysbususb, name, attr);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (!fgets(buf, size, f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	len = strlen(buf);
+	if (len && buf[len - 1] == '\n')
+		buf[len - 1] = 0;
+	return 0;
+}
+
+/* read an integer attribute of /sys/bus/usb/devices/<name>, -1 on error */
+int read_sysfs_attr_int(const char *name, const char *attr)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int val = -1;
+
+	snprintf(path, sizeof(path), "%s/%s/%s", sysbususb, name, attr);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%d", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+/*
+ * Find the sysfs name ("1-2.3", "usb1") of a device by matching its bus
+ * number and device address.  Returns 0 on success.
+ */
+int get_sysfs_name(char *buf, size_t size, libusb_device *dev)
+{
+	int bnum = libusb_get_bus_number(dev);
+	int dnum = libusb_get_device_address(dev);
+	struct dirent *de;
+	DIR *d;
+	int ret = -1;
+
+	d = opendir(sysbususb);
+	if (!d)
+		return -1;
+	while ((de = readdir(d))) {
+		/* interfaces ("1-2:1.0") have no busnum/devnum */
+		if (de->d_name[0] == '.' || strchr(de->d_name, ':'))
+			continue;
+		if (read_sysfs_attr_int(de->d_name, "busnum") == bnum &&
+		    read_sysfs_attr_int(de->d_name, "devnum") == dnum) {
+			snprintf(buf, size, "%s", de->d_name);
+			ret = 0;
+			break;
+		}
+	}
+	closedir(d);
+	return ret;
+}
+
+/*
+ * Name of the kernel driver bound to an interface of the device with
+ * sysfs name 'name', as shown by the driver link in sysfs.  Returns 0 if
+ * a driver is bound.
+ */
+int get_interface_driver_sysfs(char *buf, size_t size, const char *name,
+			       int config, int ifnum)
+{
+	char path[PATH_MAX], link[PATH_MAX];
+	ssize_t n;
+	char *p;
+
+	snprintf(path, sizeof(path), "%s/%s:%d.%d/driver", sysbususb,
+		 name, config, ifnum);
+	n = readlink(path, link, sizeof(link) - 1);
+	if (n <= 0)
+		return -1;
+	link[n] = 0;
+	p = strrchr(link, '/');
+	snprintf(buf, size, "%s", p ? p + 1 : link);
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/*
+ * A configuration descriptor parsed from a raw buffer, such as an
+ * OTHER_SPEED_CONFIGURATION, laid out like libusb's own so that it can
+ * be shown with the same code.  The libusb struct must come first.
+ */
+struct raw_config {
+	struct libusb_config_descriptor config;
+	unsigned char *raw;
+	struct libusb_interface *interfaces;
+	struct libusb_interface_descriptor *alts;
+	struct libusb_endpoint_descriptor *endpoints;
+};
+
+/* length of the descriptors up to the next interface or endpoint */
+static int extra_length(const unsigned char *buf, int size)
+{
+	int len = 0;
+
+	while (size - len >= 2 && buf[len] >= 2 && buf[len] <= size - len) {
+		if (buf[len + 1] == LIBUSB_DT_INTERFACE ||
+		    buf[len + 1] == LIBUSB_DT_ENDPOINT)
+			break;
+		len += buf[len];
+	}
+	return len;
+}
+
+int parse_config_descriptor(const unsigned char *buf, int size,
+			    struct libusb_config_descriptor **config)
+{
+	struct libusb_interface_descriptor *alts, *sorted;
+	struct libusb_endpoint_descriptor *ep;
+	struct libusb_interface *intf;
+	struct raw_config *rc;
+	unsigned char *p;
+	int nalts = 0, neps = 0, nifs = 0, len, i, j, n;
+
+	if (size < LIBUSB_DT_CONFIG_SIZE || buf[0] < LIBUSB_DT_CONFIG_SIZE)
+		return -1;
+	len = buf[2] | (buf[3] << 8);
+	if (len < LIBUSB_DT_CONFIG_SIZE)
+		return -1;
+	if (len < size)
+		size = len;
+
+	for (i = 0; i + 2 <= size && buf[i] >= 2 && buf[i] <= size - i; i += buf[i]) {
+		if (buf[i + 1] == LIBUSB_DT_INTERFACE && buf[i] >= LIBUSB_DT_INTERFACE_SIZE)
+			nalts++;
+		else if (buf[i + 1] == LIBUSB_DT_ENDPOINT && buf[i] >= LIBUSB_DT_ENDPOINT_SIZE)
+			neps++;
+	}
+
+	rc = calloc(1, sizeof(*rc));
+	if (!rc)
+		return -1;
+	rc->raw = malloc(size);
+	rc->interfaces = calloc(nalts + 1, sizeof(*rc->interfaces));
+	rc->alts = calloc(nalts + 1, sizeof(*rc->alts));
+	alts = calloc(nalts + 1, sizeof(*alts));
+	rc->endpoints = calloc(neps + 1, sizeof(*rc->endpoints));
+	if (!rc->raw || !rc->interfaces || !rc->alts || !alts || !rc->endpoints) {
+		free(alts);
+		free_config_descriptor(&rc->config);
+		return -1;
+	}
+	memcpy(rc->raw, buf, size);
+	p = rc->raw;
+
+	rc->config.bLength = p[0];
+	rc->config.bDescriptorType = p[1];
+	rc->config.wTotalLength = len;
+	rc->config.bConfigurationValue = p[5];
+	rc->config.iConfiguration = p[6];
+	rc->config.bmAttributes = p[7];
+	rc->config.MaxPower = p[8];
+	i = p[0];
+	rc->config.extra = p + i;
+	rc->config.extra_length = extra_length(p + i, size - i);
+
+	/* alt settings in descriptor order, each followed by its endpoints */
+	nalts = 0;
+	ep = rc->endpoints;
+	while (i + 2 <= size && p[i] >= 2 && p[i] <= size - i) {
+		if (p[i + 1] == LIBUSB_DT_INTERFACE && p[i] >= LIBUSB_DT_INTERFACE_SIZE) {
+			struct libusb_interface_descriptor *alt = &alts[nalts++];
+
+			alt->bLength = p[i];
+			alt->bDescriptorType = p[i + 1];
+			alt->bInterfaceNumber = p[i + 2];
+			alt->bAlternateSetting = p[i + 3];
+			alt->bInterfaceClass = p[i + 5];
+			alt->bInterfaceSubClass = p[i + 6];
+			alt->bInterfaceProtocol = p[i + 7];
+			alt->iInterface = p[i + 8];
+			alt->endpoint = ep;
+			i += p[i];
+			alt->extra = p + i;
+			alt->extra_length = extra_length(p + i, size - i);
+			i += alt->extra_length;
+		} else if (p[i + 1] == LIBUSB_DT_ENDPOINT && p[i] >= LIBUSB_DT_ENDPOINT_SIZE &&
+			   nalts) {
+			ep->bLength = p[i];
+			ep->bDescriptorType = p[i + 1];
+			ep->bEndpointAddress = p[i + 2];
+			ep->bmAttributes = p[i + 3];
+			ep->wMaxPacketSize = p[i + 4] | (p[i + 5] << 8);
+			ep->bInterval = p[i + 6];
+			if (p[i] >= LIBUSB_DT_ENDPOINT_AUDIO_SIZE) {
+				ep->bRefresh = p[i + 7];
+				ep->bSynchAddress = p[i + 8];
+			}
+			i += p[i];
+			ep->extra = p + i;
+			ep->extra_length = extra_length(p + i, size - i);
+			i += ep->extra_length;
+			alts[nalts - 1].bNumEndpoints++;
+			ep++;
+		} else {
+			i += p[i];
+		}
+	}
+
+	/* group the alt settings by interface, in order of first appearance */
+	sorted = rc->alts;
+	for (i = 0; i < nalts; i++) {
+		for (j = 0; j < i; j++)
+			if (alts[j].bInterfaceNumber == alts[i].bInterfaceNumber)
+				break;
+		if (j < i)
+			continue;
+		intf = &rc->interfaces[nifs++];
+		intf->altsetting = sorted;
+		for (n = 0, j = i; j < nalts; j++)
+			if (alts[j].bInterfaceNumber == alts[i].bInterfaceNumber)
+				sorted[n++] = alts[j];
+		intf->num_altsetting = n;
+		sorted += n;
+	}
+	free(alts);
+
+	rc->config.bNumInterfaces = nifs;
+	rc->config.interface = rc->interfaces;
+	*config = &rc->config;
+	return 0;
+}
+
+void free_config_descriptor(struct libusb_config_descriptor *config)
+{
+	struct raw_config *rc = (struct raw_config *)config;
+
+	if (!rc)
+		return;
+	free(rc->raw);
+	free(rc->interfaces);
+	free(rc->alts);
+	free(rc->endpoints);
+	free(rc);
+}
+
+/*
+ * Whether a device is one of those selected.  The serial number is taken
+ * from sysfs, so matching it does not need access to the device.
+ */
+int usb_match_device(libusb_device *dev,
+		     const struct libusb_device_descriptor *desc,
+		     const struct usb_match *m)
+{
+	char name[64], serial[256];
+
+	if ((m->busnum != -1 && m->busnum != libusb_get_bus_number(dev)) ||
+	    (m->devnum != -1 && m->devnum != libusb_get_device_address(dev)))
+		return 0;
+	if ((m->vendor != -1 && m->vendor != desc->idVendor) ||
+	    (m->product != -1 && m->product != desc->idProduct))
+		return 0;
+	if (!m->serial)
+		return 1;
+	return !get_sysfs_name(name, sizeof(name), dev) &&
+	       !read_sysfs_attr(serial, sizeof(serial), name, "serial") &&
+	       !strcmp(serial, m->serial);
+}
@@ -12,9 +12,46 @@
 
 /* ---------------------------------------------------------------------- */
 
+#define CTRL_TIMEOUT	(5*1000)	/* milliseconds */
+
+#define USB_DT_SS_ENDPOINT_COMP		0x30
+
+static inline unsigned int convert_le_u16(const unsigned char *buf)
+{
+	return buf[0] | (buf[1] << 8);
+}
+
+static inline unsigned int convert_le_u32(const unsigned char *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+}
+
+/* devices selected by -s, -d or --wait; -1 or NULL matches anything */
+struct usb_match {
+	int busnum;
+	int devnum;
+	int vendor;
+	int product;
+	const char *serial;
+};
+
 extern libusb_device *get_usb_device(libusb_context *ctx, const char *path);
 
 extern char *get_dev_string(libusb_device_handle *dev, uint8_t id);
 
+extern int get_sysfs_name(char *buf, size_t size, libusb_device *dev);
+extern int read_sysfs_attr(char *buf, size_t size, const char *name,
+			   const char *attr);
+extern int read_sysfs_attr_int(const char *name, const char *attr);
+
+extern int parse_config_descriptor(const unsigned char *buf, int size,
+				   struct libusb_config_descriptor **config);
+extern void free_config_descriptor(struct libusb_config_descriptor *config);
+extern int get_interface_driver_sysfs(char *buf, size_t size, const char *name,
+				      int config, int ifnum);
+extern int usb_match_device(libusb_device *dev,
+			    const struct libusb_device_descriptor *desc,
+			    const struct usb_match *m);
+
 /* ---------------------------------------------------------------------- */
 #endif /* _USBMISC_H */
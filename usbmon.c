@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * usbmon binary interface and capture file reader
+ *
+ * See Documentation/usb/usbmon.rst in the Linux kernel for the binary
+ * event format, which is also what DLT_USB_LINUX(_MMAPPED) pcap files
+ * carry.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "usbmon.h"
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define DLT_USB_LINUX		189
+#define DLT_USB_LINUX_MMAPPED	220
+
+#define MON_HDR_SIZE		48
+#define MON_HDR_SIZE_MMAPPED	64
+#define MON_ISODESC_SIZE	16
+
+/* largest record kept in memory; bigger ones are skipped */
+#define USBMON_MAX_RECORD	(16 * 1024 * 1024)
+
+#define MON_IOC_MAGIC		0x92
+#define MON_IOCQ_RING_SIZE	_IO(MON_IOC_MAGIC, 5)
+#define MON_IOCX_MFETCH		_IOWR(MON_IOC_MAGIC, 7, struct mon_mfetch_arg)
+#define MON_IOCH_MFLUSH		_IO(MON_IOC_MAGIC, 8)
+
+#define USBMON_FETCH		64	/* events per MFETCH */
+
+struct mon_mfetch_arg {
+	uint32_t *offvec;
+	uint32_t nfetch;
+	uint32_t nflush;
+};
+
+struct usbmon {
+	int fd;
+	unsigned char *ring;
+	size_t ring_size;
+	uint32_t offvec[USBMON_FETCH];
+	uint32_t nflush;
+};
+
+/* ---------------------------------------------------------------------- */
+
+static uint16_t get_u16(const unsigned char *p, int swap)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t get_u32(const unsigned char *p, int swap)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint64_t get_u64(const unsigned char *p, int swap)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap ? __builtin_bswap64(v) : v;
+}
+
+/*
+ * Decode one binary usbmon header followed by its data.  mmapped headers
+ * (64 bytes) put the isochronous descriptors in front of the data.
+ */
+static int decode_event(const unsigned char *p, size_t len, int mmapped,
+			int swap, struct usbmon_event *ev)
+{
+	size_t hdr = mmapped ? MON_HDR_SIZE_MMAPPED : MON_HDR_SIZE;
+	size_t skip = hdr;
+
+	if (len < hdr)
+		return -1;
+	ev->id = get_u64(p, swap);
+	ev->type = p[8];
+	ev->xfer_type = p[9];
+	ev->epnum = p[10];
+	ev->devnum = p[11];
+	ev->busnum = get_u16(p + 12, swap);
+	ev->setup = p[14] == 0;
+	ev->ts_usec = get_u64(p + 16, swap) * 1000000 + get_u32(p + 24, swap);
+	ev->status = get_u32(p + 28, swap);
+	ev->length = get_u32(p + 32, swap);
+	ev->len_cap = get_u32(p + 36, swap);
+	memcpy(ev->setup_packet, p + 40, 8);
+	if (mmapped && ev->xfer_type == USBMON_ISO)
+		skip += (size_t)get_u32(p + 60, swap) * MON_ISODESC_SIZE;
+	if (skip > len)
+		skip = len;
+	if (ev->len_cap > len - skip)
+		ev->len_cap = len - skip;
+	ev->data = p + skip;
+	return 0;
+}
+
+int usbmon_device_ids(const struct usbmon_event *ev, uint16_t *vendor,
+		      uint16_t *product)
+{
+	const unsigned char *d = ev->data;
+
+	if (ev->type != 'C' || ev->xfer_type != USBMON_CTRL || ev->epnum != 0x80 ||
+	    ev->len_cap < 12 || d[0] != 18 || d[1] != 1)
+		return -1;
+	*vendor = d[8] | (d[9] << 8);
+	*product = d[10] | (d[11] << 8);
+	return 0;
+}
+
+int usbmon_read_pcap(const char *path, usbmon_fn fn, void *data)
+{
+	unsigned char fhdr[24], rhdr[16], *buf = NULL;
+	size_t bufsize = 0, len;
+	struct usbmon_event ev;
+	int swap, mmapped, ret = -1;
+	uint32_t magic, linktype;
+	FILE *f;
+
+	f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	setvbuf(f, NULL, _IOFBF, 1 << 20);
+	/*
+	 * Read once front to back: let readahead run, don't keep it cached.
+	 * The advice values are not flags, so give them one at a time; they
+	 * are only hints and fail on a pipe, so errors are ignored.
+	 */
+	(void)posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL);
+	(void)posix_fadvise(fileno(f), 0, 0, POSIX_FADV_NOREUSE);
+
+	if (fread(fhdr, sizeof(fhdr), 1, f) != 1)
+		goto bad;
+	memcpy(&magic, fhdr, sizeof(magic));
+	if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NSEC)
+		swap = 0;
+	else if (__builtin_bswap32(magic) == PCAP_MAGIC ||
+		 __builtin_bswap32(magic) == PCAP_MAGIC_NSEC)
+		swap = 1;
+	else
+		goto bad;
+	linktype = get_u32(fhdr + 20, swap) & 0x0fffffff;
+	if (linktype != DLT_USB_LINUX && linktype != DLT_USB_LINUX_MMAPPED)
+		goto bad;
+	mmapped = linktype == DLT_USB_LINUX_MMAPPED;
+
+	while (fread(rhdr, sizeof(rhdr), 1, f) == 1) {
+		len = get_u32(rhdr + 8, swap);
+		if (len > USBMON_MAX_RECORD) {
+			if (fseek(f, len, SEEK_CUR))
+				goto out;
+			continue;
+		}
+		if (len > bufsize) {
+			unsigned char *n = realloc(buf, len);
+
+			if (!n)
+				goto out;
+			buf = n;
+			bufsize = len;
+		}
+		if (len && fread(buf, len, 1, f) != 1)
+			break;		/* truncated capture */
+		if (decode_event(buf, len, mmapped, swap, &ev))
+			continue;
+		if (fn(&ev, data))
+			break;
+	}
+	ret = 0;
+	goto out;
+bad:
+	fprintf(stderr, "%s: not a usbmon pcap capture\n", path);
+out:
+	free(buf);
+	if (f != stdin)
+		fclose(f);
+	return ret;
+}
+
+/* ---------------------------------------------------------------------- */
+
+struct usbmon *usbmon_open(unsigned int bus)
+{
+	struct usbmon *mon;
+	char path[32];
+	int size;
+
+	mon = calloc(1, sizeof(*mon));
+	if (!mon)
+		return NULL;
+	snprintf(path, sizeof(path), "/dev/usbmon%u", bus);
+	mon->fd = open(path, O_RDONLY);
+	if (mon->fd < 0) {
+		fprintf(stderr, "%s: %s (is the usbmon module loaded?)\n",
+			path, strerror(errno));
+		free(mon);
+		return NULL;
+	}
+	size = ioctl(mon->fd, MON_IOCQ_RING_SIZE);
+	if (size > 0) {
+		mon->ring = mmap(NULL, size, PROT_READ, MAP_SHARED, mon->fd, 0);
+		if (mon->ring == MAP_FAILED)
+			mon->ring = NULL;
+		else
+			mon->ring_size = size;
+	}
+	if (!mon->ring) {
+		fprintf(stderr, "%s: can't map the event ring\n", path);
+		close(mon->fd);
+		free(mon);
+		return NULL;
+	}
+	return mon;
+}
+
+int usbmon_poll(struct usbmon *mon, int timeout, usbmon_fn fn, void *data)
+{
+	struct pollfd pfd = { .fd = mon->fd, .events = POLLIN };
+	struct mon_mfetch_arg arg;
+	struct usbmon_event ev;
+	uint32_t i, off;
+	int ret;
+
+	ret = poll(&pfd, 1, timeout);
+	if (ret <= 0)
+		return ret < 0 && errno != EINTR ? -1 : 0;
+
+	/* the events handed out last time are released by this fetch */
+	arg.offvec = mon->offvec;
+	arg.nfetch = USBMON_FETCH;
+	arg.nflush = mon->nflush;
+	mon->nflush = 0;
+	if (ioctl(mon->fd, MON_IOCX_MFETCH, &arg) < 0)
+		return errno == EINTR ? 0 : -1;
+
+	for (i = 0; i < arg.nfetch; i++) {
+		off = mon->offvec[i];
+		if (off + MON_HDR_SIZE_MMAPPED > mon->ring_size)
+			continue;
+		/* '@' marks filler at the end of the ring */
+		if (mon->ring[off + 8] == '@')
+			continue;
+		if (decode_event(mon->ring + off, mon->ring_size - off, 1, 0, &ev))
+			continue;
+		if (fn(&ev, data))
+			break;
+	}
+	mon->nflush = arg.nfetch;
+	return arg.nfetch;
+}
+
+void usbmon_close(struct usbmon *mon)
+{
+	if (!mon)
+		return;
+	if (mon->nflush)
+		ioctl(mon->fd, MON_IOCH_MFLUSH, mon->nflush);
+	munmap(mon->ring, mon->ring_size);
+	close(mon->fd);
+	free(mon);
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * usbmon binary interface and capture file reader
+ */
+
+#ifndef _USBMON_H
+#define _USBMON_H
+
+#include <stdint.h>
+
+/* ---------------------------------------------------------------------- */
+
+/* usbmon transfer types, not the USB ones */
+#define USBMON_ISO		0
+#define USBMON_INTR		1
+#define USBMON_CTRL		2
+#define USBMON_BULK		3
+
+/* one usbmon event, host byte order */
+struct usbmon_event {
+	uint64_t id;			/* URB tag, the same for submit and complete */
+	char type;			/* 'S'ubmit, 'C'omplete or 'E'rror */
+	uint8_t xfer_type;		/* USBMON_* */
+	uint8_t epnum;			/* with USB_DIR_IN (0x80) */
+	uint8_t devnum;
+	uint16_t busnum;
+	int setup;			/* setup[] is valid */
+	uint64_t ts_usec;		/* microseconds since the epoch */
+	int32_t status;
+	uint32_t length;		/* requested (S) or actual (C) length */
+	uint32_t len_cap;		/* bytes of data[] */
+	unsigned char setup_packet[8];
+	const unsigned char *data;
+};
+
+/* return non-zero to stop reading */
+typedef int (*usbmon_fn)(const struct usbmon_event *ev, void *data);
+
+/*
+ * Stream the events of a pcap file of link type 189 (DLT_USB_LINUX) or
+ * 220 (DLT_USB_LINUX_MMAPPED) to fn, one record at a time.  Returns 0 at
+ * the end of the file, -1 on error.
+ */
+extern int usbmon_read_pcap(const char *path, usbmon_fn fn, void *data);
+
+/*
+ * Vendor and product ID from a completed GET_DESCRIPTOR(DEVICE) seen in
+ * the trace.  Returns 0 if ev is one.
+ */
+extern int usbmon_device_ids(const struct usbmon_event *ev, uint16_t *vendor,
+			     uint16_t *product);
+
+/*
+ * Live capture through the memory mapped ring of /dev/usbmonN, bus 0
+ * being all buses.  usbmon_poll() hands the events that arrived within
+ * timeout milliseconds to fn.
+ */
+struct usbmon;
+extern struct usbmon *usbmon_open(unsigned int bus);
+extern int usbmon_poll(struct usbmon *mon, int timeout, usbmon_fn fn, void *data);
+extern void usbmon_close(struct usbmon *mon);
+
+/* ---------------------------------------------------------------------- */
+#endif /* _USBMON_H */
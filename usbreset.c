@@ -14,14 +14,34 @@
 #include <ctype.h>
 #include <limits.h>
 #include <dirent.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
+#include <linux/netlink.h>
 #include <linux/usbdevice_fs.h>
 
 
 /* static char *usbfs = NULL; */
 
+static bool verbose;
+
+/* attributes of a usbentry read so far */
+#define ATTR_BUSNUM		0x01
+#define ATTR_DEVNUM		0x02
+#define ATTR_VENDOR_ID		0x04
+#define ATTR_PRODUCT_ID		0x08
+#define ATTR_VENDOR_NAME	0x10
+#define ATTR_PRODUCT_NAME	0x20
+#define ATTR_ALL		0x3f
+
 struct usbentry {
+	char name[32];		/* sysfs name, the port path */
+	unsigned int loaded;
 	int bus_num;
 	int dev_num;
 	int vendor_id;
@@ -30,6 +50,17 @@ struct usbentry {
 	char product_name[128];
 };
 
+/* what to look for; unset fields match anything */
+struct usbmatch {
+	int bus_num;		/* with dev_num, -1 if unset */
+	int dev_num;
+	int vendor_id;		/* with product_id, -1 if unset */
+	int product_id;
+	const char *product;
+	const char *port;
+	const char *serial;
+};
+
 static char *sysfs_attr(const char *dev, const char *attr)
 {
 	int fd, len = 0;
@@ -51,9 +82,36 @@ static char *sysfs_attr(const char *dev, const char *attr)
 	return (len >= 0) ? buf : NULL;
 }
 
-static struct usbentry *parse_devlist(DIR *d)
+/* read only the attributes asked for that have not been read yet */
+static void load_attrs(struct usbentry *dev, unsigned int want)
 {
 	char *attr;
+
+	want &= ~dev->loaded;
+	dev->loaded |= want;
+
+	if ((want & ATTR_BUSNUM) && (attr = sysfs_attr(dev->name, "busnum")))
+		dev->bus_num = strtoul(attr, NULL, 10);
+
+	if ((want & ATTR_DEVNUM) && (attr = sysfs_attr(dev->name, "devnum")))
+		dev->dev_num = strtoul(attr, NULL, 10);
+
+	if ((want & ATTR_VENDOR_ID) && (attr = sysfs_attr(dev->name, "idVendor")))
+		dev->vendor_id = strtoul(attr, NULL, 16);
+
+	if ((want & ATTR_PRODUCT_ID) && (attr = sysfs_attr(dev->name, "idProduct")))
+		dev->product_id = strtoul(attr, NULL, 16);
+
+	if ((want & ATTR_VENDOR_NAME) && (attr = sysfs_attr(dev->name, "manufacturer")))
+		strcpy(dev->vendor_name, attr);
+
+	if ((want & ATTR_PRODUCT_NAME) && (attr = sysfs_attr(dev->name, "product")))
+		strcpy(dev->product_name, attr);
+}
+
+/* the next device, with nothing but its name read */
+static struct usbentry *parse_devlist(DIR *d)
+{
 	struct dirent *e;
 	static struct usbentry dev;
 
@@ -65,35 +123,9 @@ static struct usbentry *parse_devlist(DIR *d)
 	} while (!isdigit(e->d_name[0]) || strchr(e->d_name, ':'));
 
 	memset(&dev, 0, sizeof(dev));
+	snprintf(dev.name, sizeof(dev.name), "%.31s", e->d_name);
 
-	attr = sysfs_attr(e->d_name, "busnum");
-	if (attr)
-		dev.bus_num = strtoul(attr, NULL, 10);
-
-	attr = sysfs_attr(e->d_name, "devnum");
-	if (attr)
-		dev.dev_num = strtoul(attr, NULL, 10);
-
-	attr = sysfs_attr(e->d_name, "idVendor");
-	if (attr)
-		dev.vendor_id = strtoul(attr, NULL, 16);
-
-	attr = sysfs_attr(e->d_name, "idProduct");
-	if (attr)
-		dev.product_id = strtoul(attr, NULL, 16);
-
-	attr = sysfs_attr(e->d_name, "manufacturer");
-	if (attr)
-		strcpy(dev.vendor_name, attr);
-
-	attr = sysfs_attr(e->d_name, "product");
-	if (attr)
-		strcpy(dev.product_name, attr);
-
-	if (dev.bus_num && dev.dev_num && dev.vendor_id && dev.product_id)
-		return &dev;
-
-	return NULL;
+	return &dev;
 }
 
 static void list_devices(void)
@@ -104,17 +136,57 @@ static void list_devices(void)
 	if (!devs)
 		return;
 
-	while ((dev = parse_devlist(devs)) != NULL)
-		printf("  Number %03d/%03d  ID %04x:%04x  %s\n",
+	while ((dev = parse_devlist(devs)) != NULL) {
+		load_attrs(dev, ATTR_ALL);
+		printf("  Number %03d/%03d  ID %04x:%04x  %-10s %s\n",
 			   dev->bus_num, dev->dev_num,
 			   dev->vendor_id, dev->product_id,
-			   dev->product_name);
+			   dev->name, dev->product_name);
+	}
 
 	closedir(devs);
 }
 
-static struct usbentry *find_device(int *bus, int *dev, int *vid, int *pid,
-				    const char *product)
+/*
+ * The cheapest tests go first: the port path and bus number are in the
+ * name, and each attribute is only read when a test needs it.
+ */
+static bool match_device(struct usbentry *e, const struct usbmatch *m)
+{
+	char *attr;
+
+	if (m->port && strcmp(e->name, m->port))
+		return false;
+	if (m->bus_num >= 0) {
+		if (atoi(e->name) != m->bus_num)
+			return false;
+		load_attrs(e, ATTR_DEVNUM);
+		if (e->dev_num != m->dev_num)
+			return false;
+	}
+	if (m->vendor_id >= 0) {
+		load_attrs(e, ATTR_VENDOR_ID);
+		if (e->vendor_id != m->vendor_id)
+			return false;
+		load_attrs(e, ATTR_PRODUCT_ID);
+		if (e->product_id != m->product_id)
+			return false;
+	}
+	if (m->product) {
+		load_attrs(e, ATTR_PRODUCT_NAME);
+		if (strcasecmp(e->product_name, m->product))
+			return false;
+	}
+	if (m->serial) {
+		attr = sysfs_attr(e->name, "serial");
+		if (!attr || strcmp(attr, m->serial))
+			return false;
+	}
+	load_attrs(e, ATTR_ALL);
+	return true;
+}
+
+static struct usbentry *find_device(const struct usbmatch *m)
 {
 	DIR *devs = opendir("/sys/bus/usb/devices");
 
@@ -124,9 +196,7 @@ static struct usbentry *find_device(int *bus, int *dev, int *vid, int *pid,
 		return NULL;
 
 	while ((e = parse_devlist(devs)) != NULL)
-		if ((bus && (e->bus_num == *bus) && (e->dev_num == *dev)) ||
-			(vid && (e->vendor_id == *vid) && (e->product_id == *pid)) ||
-			(product && !strcasecmp(e->product_name, product))) {
+		if (match_device(e, m)) {
 			match = e;
 			break;
 		}
@@ -136,6 +206,32 @@ static struct usbentry *find_device(int *bus, int *dev, int *vid, int *pid,
 	return match;
 }
 
+/* every match, not just the first; returns the number found */
+static int find_devices(struct usbentry **list, const struct usbmatch *m)
+{
+	DIR *devs = opendir("/sys/bus/usb/devices");
+	struct usbentry *e, *n;
+	int count = 0;
+
+	*list = NULL;
+	if (!devs)
+		return 0;
+
+	while ((e = parse_devlist(devs)) != NULL) {
+		if (!match_device(e, m))
+			continue;
+		n = realloc(*list, (count + 1) * sizeof(*n));
+		if (!n)
+			break;
+		*list = n;
+		(*list)[count++] = *e;
+	}
+
+	closedir(devs);
+
+	return count;
+}
+
 static void reset_device(struct usbentry *dev)
 {
 	int fd;
@@ -160,32 +256,776 @@ static void reset_device(struct usbentry *dev)
 }
 
 
+/*
+ * Resetting many devices: each reset runs in a child, since the ioctl
+ * blocks until the port is reset and the device reconfigured.  At most
+ * 'per_hub' run at once behind any one hub, and a hub and a device behind
+ * it are never reset at the same time.  Kernel uevents tell when to look
+ * again whether a device is back, with its interface drivers bound.
+ */
+
+#define MAX_INTERFACES	32
+#define MAX_TIMEOUT_S	(24*60*60)	/* -t, in seconds */
+
+enum { WAITING, RESETTING, RECOVERING, READY, FAILED, TIMEDOUT, LOST };
+
+struct target {
+	struct usbentry dev;
+	char hub[32];				/* parent device's sysfs name */
+	char intf[MAX_INTERFACES][40];		/* interfaces bound before */
+	char driver[MAX_INTERFACES][32];	/* and their drivers */
+	int nintf;
+	int state;
+	pid_t pid;
+	int fd;					/* the child's result */
+	int err;
+	double start;
+	double reset_ms;			/* until the ioctl returned */
+	double enum_ms;				/* until a new devnum, if any */
+	double ready_ms;			/* until the drivers were back */
+};
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static bool sysfs_exists(const char *dev, const char *attr)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s/%s", dev, attr);
+	return stat(path, &st) == 0;
+}
+
+/* "1-2.3" is behind "1-2", "1-2" behind root hub "usb1" */
+static void hub_name(char *buf, size_t size, const char *name)
+{
+	const char *p = strrchr(name, '.');
+
+	if (p)
+		snprintf(buf, size, "%.*s", (int)(p - name), name);
+	else
+		snprintf(buf, size, "usb%d", atoi(name));
+}
+
+/* remember which interfaces have a driver, to know when they are back */
+static void save_interfaces(struct target *t)
+{
+	DIR *devs = opendir("/sys/bus/usb/devices");
+	size_t len = strlen(t->dev.name);
+	char path[PATH_MAX], link[PATH_MAX];
+	struct dirent *e;
+	ssize_t l;
+	char *p;
+
+	t->nintf = 0;
+	if (!devs)
+		return;
+	while ((e = readdir(devs)) != NULL && t->nintf < MAX_INTERFACES) {
+		if (strncmp(e->d_name, t->dev.name, len) || e->d_name[len] != ':')
+			continue;
+		snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s/driver", e->d_name);
+		l = readlink(path, link, sizeof(link) - 1);
+		if (l < 0)
+			continue;
+		link[l] = 0;
+		p = strrchr(link, '/');
+		snprintf(t->intf[t->nintf], sizeof(t->intf[0]), "%.39s", e->d_name);
+		snprintf(t->driver[t->nintf], sizeof(t->driver[0]), "%.31s", p ? p + 1 : link);
+		t->nintf++;
+	}
+	closedir(devs);
+}
+
+static int sysfs_devnum(const char *name)
+{
+	char *attr = sysfs_attr(name, "devnum");
+
+	return attr && *attr ? (int)strtoul(attr, NULL, 10) : -1;
+}
+
+static bool is_ready(struct target *t)
+{
+	int devnum = sysfs_devnum(t->dev.name), i;
+
+	if (devnum < 0)
+		return false;
+	/* a reset that changed the descriptors re-enumerates the device */
+	if (t->err == ENODEV && devnum == t->dev.dev_num)
+		return false;
+	for (i = 0; i < t->nintf; i++)
+		if (!sysfs_exists(t->intf[i], "driver"))
+			return false;
+	return true;
+}
+
+static void start_reset(struct target *t)
+{
+	char path[PATH_MAX];
+	int pipefd[2], fd, err;
+
+	t->start = now_ms();
+	/* a hub reset before this one may have re-enumerated the device */
+	err = sysfs_devnum(t->dev.name);
+	if (err > 0)
+		t->dev.dev_num = err;
+	if (pipe(pipefd) < 0) {
+		t->err = errno;
+		t->state = FAILED;
+		return;
+	}
+	t->pid = fork();
+	if (t->pid == 0) {
+		close(pipefd[0]);
+		snprintf(path, sizeof(path), "/dev/bus/usb/%03d/%03d",
+			 t->dev.bus_num, t->dev.dev_num);
+		fd = open(path, O_WRONLY);
+		if (fd < 0 || ioctl(fd, USBDEVFS_RESET, 0) < 0)
+			err = errno;
+		else
+			err = 0;
+		if (write(pipefd[1], &err, sizeof(err)) < 0)
+			_exit(1);
+		_exit(0);
+	}
+	close(pipefd[1]);
+	if (t->pid < 0) {
+		close(pipefd[0]);
+		t->err = errno;
+		t->state = FAILED;
+		return;
+	}
+	t->fd = pipefd[0];
+	t->state = RESETTING;
+}
+
+static void finish_reset(struct target *t)
+{
+	int err = EIO;
+
+	if (read(t->fd, &err, sizeof(err)) != sizeof(err))
+		err = EIO;
+	close(t->fd);
+	waitpid(t->pid, NULL, 0);
+	t->pid = 0;
+	t->reset_ms = now_ms() - t->start;
+	t->err = err;
+	/* ENODEV: the device was logically disconnected and comes back anew */
+	t->state = (err && err != ENODEV) ? FAILED : RECOVERING;
+}
+
+static int running_on_hub(struct target *targets, int n, const char *hub)
+{
+	int i, count = 0;
+
+	for (i = 0; i < n; i++)
+		if (targets[i].state == RESETTING && !strcmp(targets[i].hub, hub))
+			count++;
+	return count;
+}
+
+/* is device 'name' anywhere behind hub 'hub'? */
+static bool is_behind(const char *name, const char *hub)
+{
+	size_t len = strlen(hub);
+
+	if (!strncmp(hub, "usb", 3))
+		return strncmp(name, "usb", 3) && atoi(name) == atoi(hub + 3);
+	return !strncmp(name, hub, len) && name[len] == '.';
+}
+
+/* is a hub above t, or a device below it, being reset or coming back? */
+static bool lineage_busy(struct target *targets, int n, struct target *t)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (&targets[i] == t ||
+		    (targets[i].state != RESETTING && targets[i].state != RECOVERING))
+			continue;
+		if (is_behind(t->dev.name, targets[i].dev.name) ||
+		    is_behind(targets[i].dev.name, t->dev.name))
+			return true;
+	}
+	return false;
+}
+
+/* collect the children of timed out resets that have finished since */
+static void reap_timedout(struct target *targets, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (targets[i].state == TIMEDOUT && targets[i].pid > 0 &&
+		    waitpid(targets[i].pid, NULL, WNOHANG) == targets[i].pid)
+			targets[i].pid = 0;
+}
+
+static int uevent_open(void)
+{
+	struct sockaddr_nl nl;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -1;
+	memset(&nl, 0, sizeof(nl));
+	nl.nl_family = AF_NETLINK;
+	nl.nl_groups = 1;		/* kernel events */
+	if (bind(fd, (struct sockaddr *)&nl, sizeof(nl)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* whether any of the queued uevents is about a USB device or interface */
+static bool uevent_usb(int fd)
+{
+	char buf[8192];
+	bool usb = false;
+	ssize_t len;
+	int i;
+
+	while ((len = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = 0;
+		for (i = 0; i < len; i += strlen(buf + i) + 1)
+			if (!strcmp(buf + i, "SUBSYSTEM=usb"))
+				usb = true;
+	}
+	return usb;
+}
+
+static void print_target(struct target *t, int timeout_ms)
+{
+	printf("%-12s %04x:%04x  %-24.24s ", t->dev.name, t->dev.vendor_id,
+	       t->dev.product_id, t->dev.product_name);
+	if (t->state == READY)
+		printf("reset %8.1f ms  ready %8.1f ms\n", t->reset_ms, t->ready_ms);
+	else if (t->state == FAILED)
+		printf("failed [%s]\n", strerror(t->err));
+	else if (t->state == TIMEDOUT)
+		printf("reset still running after %d ms\n", timeout_ms);
+	else if (t->state == LOST)
+		printf("reset %8.1f ms  not ready after %d ms\n", t->reset_ms, timeout_ms);
+	else
+		printf("not reset\n");
+}
+
+/* reset the targets, and wait for them to be back or to time out */
+static int run_targets(struct target *targets, int n, int per_hub, int timeout_ms,
+		       int uevents)
+{
+	struct target *t;
+	struct pollfd *pfd;
+	int i, j, npfd, pending = n;
+	bool check;
+	double now;
+	int devnum;
+
+	pfd = calloc(n + 1, sizeof(*pfd));
+	if (!pfd)
+		return -1;
+
+	while (pending) {
+		for (i = 0; i < n; i++)
+			if (targets[i].state == WAITING &&
+			    running_on_hub(targets, n, targets[i].hub) < per_hub &&
+			    !lineage_busy(targets, n, &targets[i])) {
+				start_reset(&targets[i]);
+				if (targets[i].state == FAILED)
+					pending--;
+			}
+
+		npfd = 0;
+		if (uevents >= 0) {
+			pfd[npfd].fd = uevents;
+			pfd[npfd++].events = POLLIN;
+		}
+		for (i = 0; i < n; i++)
+			if (targets[i].state == RESETTING) {
+				pfd[npfd].fd = targets[i].fd;
+				pfd[npfd++].events = POLLIN;
+			}
+		/* the tick bounds how late a timeout is noticed */
+		if (poll(pfd, npfd, 100) < 0 && errno != EINTR)
+			break;
+		reap_timedout(targets, n);
+
+		/* without uevents, look every time around */
+		check = uevents < 0;
+		if (uevents >= 0 && (pfd[0].revents & POLLIN))
+			check |= uevent_usb(uevents);
+		for (j = uevents >= 0; j < npfd; j++) {
+			if (!pfd[j].revents)
+				continue;
+			for (t = targets; t->state != RESETTING || t->fd != pfd[j].fd; t++)
+				;
+			finish_reset(t);
+			if (t->state == FAILED)
+				pending--;
+			check = true;
+		}
+
+		now = now_ms();
+		for (i = 0, t = targets; i < n; i++, t++) {
+			if (t->state == RECOVERING && check && !t->enum_ms) {
+				devnum = sysfs_devnum(t->dev.name);
+				if (devnum > 0 && devnum != t->dev.dev_num)
+					t->enum_ms = now - t->start;
+			}
+			if (t->state == RECOVERING && check && is_ready(t)) {
+				t->ready_ms = now - t->start;
+				t->state = READY;
+				pending--;
+			} else if ((t->state == RESETTING || t->state == RECOVERING) &&
+				   now - t->start >= timeout_ms) {
+				/* the child is left to finish the ioctl, and reaped after */
+				if (t->state == RESETTING)
+					close(t->fd);
+				t->state = t->state == RESETTING ? TIMEDOUT : LOST;
+				pending--;
+			}
+		}
+	}
+	reap_timedout(targets, n);
+	free(pfd);
+	return 0;
+}
+
+static int reset_devices(struct usbentry *devs, int n, int per_hub, int timeout_ms)
+{
+	struct target *targets;
+	int i, failed = 0, uevents;
+
+	targets = calloc(n, sizeof(*targets));
+	if (!targets)
+		return 1;
+	for (i = 0; i < n; i++) {
+		targets[i].dev = devs[i];
+		hub_name(targets[i].hub, sizeof(targets[i].hub), devs[i].name);
+		save_interfaces(&targets[i]);
+	}
+
+	/* listen before resetting, so that no event is missed */
+	uevents = uevent_open();
+	if (uevents < 0)
+		fprintf(stderr, "no uevents [%s], polling\n", strerror(errno));
+	if (run_targets(targets, n, per_hub, timeout_ms, uevents) < 0)
+		failed++;
+	if (uevents >= 0)
+		close(uevents);
+
+	for (i = 0; i < n; i++) {
+		print_target(&targets[i], timeout_ms);
+		if (targets[i].state != READY)
+			failed++;
+	}
+	free(targets);
+	return failed ? 1 : 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+static void print_stat(const char *what, double *v, int n)
+{
+	int p99 = (n * 99 + 99) / 100 - 1;
+
+	if (!n) {
+		printf("  %-14s -\n", what);
+		return;
+	}
+	qsort(v, n, sizeof(*v), cmp_double);
+	printf("  %-14s %9.1f %9.1f %9.1f %9.1f  (%d)\n", what,
+	       v[0], v[n / 2], v[p99], v[n - 1], n);
+}
+
+/*
+ * Reset one device 'cycles' times and show how long the ioctl, the
+ * re-enumeration (when the device number changed) and the drivers coming
+ * back take.
+ */
+static int bench_device(struct usbentry *dev, int cycles, int timeout_ms)
+{
+	struct target t;
+	double *reset, *enumerated, *ready;
+	int i, nreset = 0, nenum = 0, nready = 0, uevents;
+
+	reset = calloc(cycles, sizeof(*reset));
+	enumerated = calloc(cycles, sizeof(*enumerated));
+	ready = calloc(cycles, sizeof(*ready));
+	if (!reset || !enumerated || !ready) {
+		free(reset);
+		free(enumerated);
+		free(ready);
+		return 1;
+	}
+
+	printf("Bus %03d Device %03d: ID %04x:%04x %s %s, port %s\n",
+	       dev->bus_num, dev->dev_num, dev->vendor_id, dev->product_id,
+	       dev->vendor_name, dev->product_name, dev->name);
+
+	uevents = uevent_open();
+	if (uevents < 0)
+		fprintf(stderr, "no uevents [%s], polling\n", strerror(errno));
+
+	for (i = 0; i < cycles; i++) {
+		memset(&t, 0, sizeof(t));
+		t.dev = *dev;
+		hub_name(t.hub, sizeof(t.hub), dev->name);
+		save_interfaces(&t);
+		if (run_targets(&t, 1, 1, timeout_ms, uevents) < 0)
+			break;
+		if (t.state == FAILED || t.state == TIMEDOUT) {
+			print_target(&t, timeout_ms);
+			break;
+		}
+		reset[nreset++] = t.reset_ms;
+		if (t.enum_ms)
+			enumerated[nenum++] = t.enum_ms;
+		if (t.state != READY) {
+			print_target(&t, timeout_ms);
+			break;
+		}
+		ready[nready++] = t.ready_ms;
+		/* a re-enumerated device has a new node */
+		dev->dev_num = sysfs_devnum(dev->name);
+		if (verbose)
+			print_target(&t, timeout_ms);
+	}
+	if (uevents >= 0)
+		close(uevents);
+
+	printf("%d of %d cycles recovered\n", nready, cycles);
+	printf("  %-14s %9s %9s %9s %9s\n", "ms", "min", "median", "99%", "max");
+	print_stat("reset ioctl", reset, nreset);
+	print_stat("re-enumerated", enumerated, nenum);
+	print_stat("drivers bound", ready, nready);
+
+	free(reset);
+	free(enumerated);
+	free(ready);
+	return nready == cycles ? 0 : 1;
+}
+
+
+/*
+ * Recovering a device with as little disruption as possible: first its
+ * interface drivers are unbound and bound again, then the device is
+ * deauthorized and authorized, which re-probes it without touching the
+ * port, and only then is the port reset.  A level counts as a success
+ * once the drivers are back and, if given, the check command succeeds.
+ */
+
+/* these return 0 or the errno of the (first) failure */
+static int sysfs_write(const char *path, const char *value)
+{
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return errno;
+	if (write(fd, value, strlen(value)) < 0)
+		ret = errno;
+	close(fd);
+	return ret;
+}
+
+static int rebind_interfaces(struct target *t)
+{
+	char path[PATH_MAX];
+	int i, err, ret = 0;
+
+	/* keep going, so that as many drivers as possible end up bound */
+	for (i = 0; i < t->nintf; i++) {
+		snprintf(path, sizeof(path), "/sys/bus/usb/drivers/%s/unbind", t->driver[i]);
+		err = sysfs_write(path, t->intf[i]);
+		if (err && !ret)
+			ret = err;
+	}
+	for (i = 0; i < t->nintf; i++) {
+		snprintf(path, sizeof(path), "/sys/bus/usb/drivers/%s/bind", t->driver[i]);
+		err = sysfs_write(path, t->intf[i]);
+		if (err && !ret)
+			ret = err;
+	}
+	return ret;
+}
+
+static int reauthorize(struct target *t)
+{
+	char path[PATH_MAX];
+	int err;
+
+	snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s/authorized", t->dev.name);
+	err = sysfs_write(path, "0");
+	if (err)
+		return err;
+	return sysfs_write(path, "1");
+}
+
+static bool wait_ready(struct target *t, int uevents, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = uevents, .events = POLLIN };
+
+	while (!is_ready(t)) {
+		if (now_ms() - t->start >= timeout_ms)
+			return false;
+		if (uevents >= 0)
+			poll(&pfd, 1, 100);
+		else
+			usleep(10000);
+		if (uevents >= 0 && (pfd.revents & POLLIN))
+			uevent_usb(uevents);
+	}
+	return true;
+}
+
+static int recover_device(struct usbentry *dev, const char *check, int timeout_ms)
+{
+	static const char * const levels[] = { "rebind", "reauthorize", "reset" };
+	struct target t;
+	int level, uevents, err;
+	bool ok;
+
+	memset(&t, 0, sizeof(t));
+	t.dev = *dev;
+	hub_name(t.hub, sizeof(t.hub), dev->name);
+	save_interfaces(&t);
+
+	printf("%-12s %04x:%04x  %s\n", dev->name, dev->vendor_id,
+	       dev->product_id, dev->product_name);
+
+	uevents = uevent_open();
+	if (uevents < 0)
+		fprintf(stderr, "no uevents [%s], polling\n", strerror(errno));
+	for (level = 0; level < 3; level++) {
+		t.start = now_ms();
+		t.err = 0;
+		t.state = WAITING;
+		if (level == 0 && !t.nintf) {
+			printf("  %-12s no drivers bound\n", levels[level]);
+			continue;
+		}
+		err = 0;
+		if (level == 0)
+			err = rebind_interfaces(&t);
+		else if (level == 1)
+			err = reauthorize(&t);
+		else if (run_targets(&t, 1, 1, timeout_ms, uevents) < 0)
+			err = ENOMEM;
+		else if (t.state == FAILED)
+			err = t.err;
+
+		if (level < 2)
+			ok = !err && wait_ready(&t, uevents, timeout_ms);
+		else
+			ok = !err && t.state == READY;
+		printf("  %-12s ", levels[level]);
+		if (err) {
+			printf("failed [%s]\n", strerror(err));
+			continue;
+		}
+		if (t.state == TIMEDOUT) {
+			printf("reset still running after %d ms\n", timeout_ms);
+			continue;
+		}
+		if (!ok) {
+			printf("drivers not back after %.1f ms\n", now_ms() - t.start);
+			continue;
+		}
+		printf("drivers back after %8.1f ms", now_ms() - t.start);
+		if (check && system(check) != 0) {
+			printf(", check failed\n");
+			continue;
+		}
+		printf("%s\n", check ? ", check ok" : "");
+		break;
+	}
+	if (uevents >= 0)
+		close(uevents);
+	if (level == 3) {
+		printf("  not recovered\n");
+		return 1;
+	}
+	return 0;
+}
+
+
+/* "1-2.3": a bus number, a dash, and port numbers separated by dots */
+static bool is_port_path(const char *s)
+{
+	if (!isdigit(*s))
+		return false;
+	s += strspn(s, "0123456789");
+	if (*s++ != '-' || !isdigit(*s))
+		return false;
+	return s[strspn(s, "0123456789.")] == 0;
+}
+
+/* a whole number in [min, max], with nothing after it */
+static bool parse_int(const char *s, int min, int max, int *val)
+{
+	char *end;
+	long v;
+
+	errno = 0;
+	v = strtol(s, &end, 10);
+	if (end == s || *end || errno || v < min || v > max)
+		return false;
+	*val = v;
+	return true;
+}
+
+/* seconds, fractions allowed, as milliseconds */
+static bool parse_seconds(const char *s, int *ms)
+{
+	char *end;
+	double v;
+
+	v = strtod(s, &end);
+	if (end == s || *end || !(v >= 0) || v > MAX_TIMEOUT_S)
+		return false;
+	*ms = v * 1000;
+	return true;
+}
+
 int main(int argc, char **argv)
 {
-	int id1, id2;
-	struct usbentry *dev;
+	static const struct option long_options[] = {
+		{ "all", 0, 0, 'a' },
+		{ "jobs", 1, 0, 'j' },
+		{ "timeout", 1, 0, 't' },
+		{ "bench", 1, 0, 'b' },
+		{ "verbose", 0, 0, 'v' },
+		{ "recover", 0, 0, 'r' },
+		{ "check", 1, 0, 'c' },
+		{ "serial", 1, 0, 's' },
+		{ 0, 0, 0, 0 }
+	};
+	struct usbmatch match = { -1, -1, -1, -1, NULL, NULL, NULL };
+	int id1, id2, c, n, cycles = 0;
+	const char *arg, *check = NULL;
+	bool all = false, recover = false, bad = false;
+	int per_hub = 1, timeout_ms = 10000;
+	struct usbentry *dev, *devs;
+
+	while ((c = getopt_long(argc, argv, "aj:t:b:vrc:s:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'r':
+			recover = true;
+			break;
+		case 'c':
+			check = optarg;
+			break;
+		case 's':
+			match.serial = optarg;
+			break;
+		case 'a':
+			all = true;
+			break;
+		case 'b':
+			if (!parse_int(optarg, 1, INT_MAX, &cycles))
+				bad = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'j':
+			if (!parse_int(optarg, 1, INT_MAX, &per_hub))
+				bad = true;
+			break;
+		case 't':
+			if (!parse_seconds(optarg, &timeout_ms))
+				bad = true;
+			break;
+		default:
+			bad = true;
+			break;
+		}
+	}
 
-	if ((argc == 2) && (sscanf(argv[1], "%3d/%3d", &id1, &id2) == 2))
-		dev = find_device(&id1, &id2, NULL, NULL, NULL);
-	else if ((argc == 2) && (sscanf(argv[1], "%4x:%4x", &id1, &id2) == 2))
-		dev = find_device(NULL, NULL, &id1, &id2, NULL);
-	else if ((argc == 2) && strlen(argv[1]) < 128)
-		dev = find_device(NULL, NULL, NULL, NULL, argv[1]);
-	else {
+	/* the modes replace each other, so only one at a time */
+	if (all + !!cycles + recover > 1) {
+		fprintf(stderr, "only one of --all, --bench and --recover can be given\n");
+		bad = true;
+	}
+	if (check && !recover) {
+		fprintf(stderr, "--check needs --recover\n");
+		bad = true;
+	}
+
+	arg = argc - optind == 1 ? argv[optind] : NULL;
+	if (arg && (sscanf(arg, "%3d/%3d", &id1, &id2) == 2)) {
+		match.bus_num = id1;
+		match.dev_num = id2;
+	} else if (arg && (sscanf(arg, "%4x:%4x", &id1, &id2) == 2)) {
+		match.vendor_id = id1;
+		match.product_id = id2;
+	} else if (arg && is_port_path(arg))
+		match.port = arg;
+	else if (arg && strlen(arg) < 128)
+		match.product = arg;
+	else if (argc != optind || !match.serial)
+		bad = true;
+
+	if (bad) {
 		printf("Usage:\n"
 		       "  usbreset PPPP:VVVV - reset by product and vendor id\n"
 		       "  usbreset BBB/DDD   - reset by bus and device number\n"
-		       "  usbreset \"Product\" - reset by product name\n\n"
+		       "  usbreset B-P.P     - reset by port path\n"
+		       "  usbreset \"Product\" - reset by product name\n"
+		       "  usbreset -s SERIAL - reset by serial number, alone or\n"
+		       "                       with any of the above\n"
+		       "  usbreset -a [-j N] [-t SECONDS] ...\n"
+		       "                     - reset all matching devices, N at a time\n"
+		       "                       behind each hub, and wait up to SECONDS\n"
+		       "                       for each to come back with its drivers\n"
+		       "  usbreset --bench N [-t SECONDS] [-v] ...\n"
+		       "                     - reset a device N times and show how long\n"
+		       "                       it takes to come back\n"
+		       "  usbreset --recover [--check COMMAND] ...\n"
+		       "                     - rebind the drivers, else reauthorize the\n"
+		       "                       device, else reset it, until COMMAND\n"
+		       "                       succeeds or the drivers are back\n\n"
 		       "Devices:\n");
 		list_devices();
 		return 1;
 	}
 
+	if (all) {
+		n = find_devices(&devs, &match);
+		if (!n) {
+			fprintf(stderr, "No such device found\n");
+			return 1;
+		}
+		c = reset_devices(devs, n, per_hub, timeout_ms);
+		free(devs);
+		return c;
+	}
+
+	dev = find_device(&match);
 	if (!dev) {
 		fprintf(stderr, "No such device found\n");
 		return 1;
 	}
 
+	if (cycles)
+		return bench_device(dev, cycles, timeout_ms);
+	if (recover)
+		return recover_device(dev, check, timeout_ms);
+
 	reset_device(dev);
 	return 0;
 }